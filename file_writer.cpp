@@ -0,0 +1,163 @@
+#include "file_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const size_t BufferedFileWriter::s_DefaultBufferSize = 8 << 20;
+
+static bool s_Seek(FILE* p_pFile, uint64_t p_Offset, int p_Origin)
+{
+#if defined(_WIN64)
+	return (_fseeki64(p_pFile, static_cast<__int64>(p_Offset), p_Origin) == 0);
+#else
+	return (fseeko(p_pFile, static_cast<off_t>(p_Offset), p_Origin) == 0);
+#endif
+}
+
+BufferedFileWriter::BufferedFileWriter(size_t p_BufferSize)
+	: m_pFile(NULL)
+	, m_BufferUsed(0)
+	, m_Position(0)
+	, m_NumWrites(0)
+	, m_WriteSeconds(0)
+{
+	m_Buffer.resize(std::max<size_t>(p_BufferSize, 4096));
+}
+
+BufferedFileWriter::~BufferedFileWriter()
+{
+	Close();
+}
+
+bool BufferedFileWriter::Open(const std::string& p_Path)
+{
+	Close();
+
+	m_pFile = fopen(p_Path.c_str(), "w+b");
+	if (m_pFile == NULL) {
+		return false;
+	}
+
+	// the stdio buffer would only add a second copy in front of ours
+	setvbuf(m_pFile, NULL, _IONBF, 0);
+
+	m_BufferUsed = 0;
+	m_Position = 0;
+	m_NumWrites = 0;
+	m_WriteSeconds = 0;
+	return true;
+}
+
+bool BufferedFileWriter::WriteFile(const void* p_pData, size_t p_Size)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+	const bool isOk = (fwrite(p_pData, 1, p_Size, m_pFile) == p_Size);
+	m_WriteSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	++m_NumWrites;
+	return isOk;
+}
+
+bool BufferedFileWriter::Write(const void* p_pData, size_t p_Size)
+{
+	if (m_pFile == NULL) {
+		return false;
+	}
+
+	m_Position += p_Size;
+
+	if (m_BufferUsed + p_Size <= m_Buffer.size()) {
+		memcpy(&m_Buffer[m_BufferUsed], p_pData, p_Size);
+		m_BufferUsed += p_Size;
+		return true;
+	}
+
+	if (!Flush()) {
+		return false;
+	}
+
+	if (p_Size >= m_Buffer.size()) {
+		return WriteFile(p_pData, p_Size);
+	}
+
+	memcpy(&m_Buffer[0], p_pData, p_Size);
+	m_BufferUsed = p_Size;
+	return true;
+}
+
+bool BufferedFileWriter::WriteAt(uint64_t p_Offset, const void* p_pData, size_t p_Size)
+{
+	if ((m_pFile == NULL) || (p_Offset + p_Size > m_Position)) {
+		return false;
+	}
+
+	// the range may still sit in the buffer, patch it there and save a seek
+	const uint64_t bufferStart = m_Position - m_BufferUsed;
+	if (p_Offset >= bufferStart) {
+		memcpy(&m_Buffer[p_Offset - bufferStart], p_pData, p_Size);
+		return true;
+	}
+
+	if (!Flush() || !s_Seek(m_pFile, p_Offset, SEEK_SET)) {
+		return false;
+	}
+
+	const bool isOk = WriteFile(p_pData, p_Size);
+	return s_Seek(m_pFile, 0, SEEK_END) && isOk;
+}
+
+bool BufferedFileWriter::Flush()
+{
+	if (m_pFile == NULL) {
+		return false;
+	}
+
+	if (m_BufferUsed == 0) {
+		return true;
+	}
+
+	const bool isOk = WriteFile(&m_Buffer[0], m_BufferUsed);
+	m_BufferUsed = 0;
+	return isOk;
+}
+
+bool BufferedFileWriter::Close()
+{
+	if (m_pFile == NULL) {
+		return true;
+	}
+
+	const bool isOk = Flush();
+	const bool isClosed = (fclose(m_pFile) == 0);
+	m_pFile = NULL;
+	return isOk && isClosed;
+}
+
+bool BufferedFileWriter::CopyFrom(const std::string& p_SrcPath, uint64_t p_Offset)
+{
+	if (!Flush()) {
+		return false;
+	}
+
+	FILE* pSrc = fopen(p_SrcPath.c_str(), "rb");
+	if (pSrc == NULL) {
+		return false;
+	}
+
+	setvbuf(pSrc, NULL, _IONBF, 0);
+
+	bool isOk = s_Seek(pSrc, p_Offset, SEEK_SET);
+	while (isOk) {
+		const size_t numRead = fread(&m_Buffer[0], 1, m_Buffer.size(), pSrc);
+		if (numRead == 0) {
+			isOk = (ferror(pSrc) == 0);
+			break;
+		}
+
+		isOk = WriteFile(&m_Buffer[0], numRead);
+		m_Position += numRead;
+	}
+
+	fclose(pSrc);
+	return isOk;
+}
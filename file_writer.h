@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// Sequential file writer that gathers small writes into one large buffer, so the file system sees
+// few big writes instead of one per packet. Writes larger than the buffer go straight to the file.
+class BufferedFileWriter
+{
+public:
+	explicit BufferedFileWriter(size_t p_BufferSize = s_DefaultBufferSize);
+	~BufferedFileWriter();
+
+	bool Open(const std::string& p_Path);
+	bool Write(const void* p_pData, size_t p_Size);
+	// overwrites already written bytes (box sizes), the write position stays at the end of the file
+	bool WriteAt(uint64_t p_Offset, const void* p_pData, size_t p_Size);
+	bool Flush();
+	bool Close();
+
+	bool IsOpen() const
+	{
+		return (m_pFile != NULL);
+	}
+
+	// logical end of the file including the buffered bytes
+	uint64_t GetPosition() const
+	{
+		return m_Position;
+	}
+
+	uint64_t GetNumWrites() const
+	{
+		return m_NumWrites;
+	}
+
+	// time spent in the file system calls
+	double GetWriteSeconds() const
+	{
+		return m_WriteSeconds;
+	}
+
+	// appends [p_Offset, end) of p_SrcPath with large reads and writes
+	bool CopyFrom(const std::string& p_SrcPath, uint64_t p_Offset);
+
+public:
+	static const size_t s_DefaultBufferSize;
+
+private:
+	BufferedFileWriter(const BufferedFileWriter& p_Other);
+	BufferedFileWriter& operator=(const BufferedFileWriter& p_Other);
+
+	bool WriteFile(const void* p_pData, size_t p_Size);
+
+private:
+	FILE* m_pFile;
+	std::vector<uint8_t> m_Buffer;
+	size_t m_BufferUsed;
+	uint64_t m_Position;
+	uint64_t m_NumWrites;
+	double m_WriteSeconds;
+};
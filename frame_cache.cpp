@@ -0,0 +1,224 @@
+#include "frame_cache.h"
+
+#include <filesystem>
+#include <system_error>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/vfs.h>
+#endif
+
+FrameCache::FrameCache()
+	: m_FrameSize(0)
+	, m_MaxBytes(0)
+	, m_HasFailed(false)
+	, m_IsOverBudget(false)
+	, m_pMapping(NULL)
+	, m_MappingSize(0)
+#if defined(_WIN32)
+	, m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(NULL)
+#endif
+{
+	for (uint32_t i = 0; i < s_NumPlanes; ++i) {
+		m_RowBytes[i] = 0;
+		m_NumRows[i] = 0;
+		m_PlaneOffsets[i] = 0;
+	}
+}
+
+FrameCache::~FrameCache()
+{
+	Close();
+}
+
+bool FrameCache::IsMemoryBacked(const std::string& p_Folder)
+{
+#if defined(__linux__)
+	// f_type values of linux/magic.h
+	const uint32_t tmpfsMagic = 0x01021994;
+	const uint32_t ramfsMagic = 0x858458f6;
+
+	struct statfs fsInfo;
+	if (statfs(p_Folder.c_str(), &fsInfo) != 0) {
+		return false;
+	}
+
+	const uint32_t fsType = static_cast<uint32_t>(fsInfo.f_type);
+	return (fsType == tmpfsMagic) || (fsType == ramfsMagic);
+#else
+	(void)p_Folder;
+	return false;
+#endif
+}
+
+bool FrameCache::Create(const std::string& p_Path, const uint32_t p_RowBytes[s_NumPlanes], const uint32_t p_NumRows[s_NumPlanes], uint64_t p_MaxBytes)
+{
+	Close();
+
+	m_Path = p_Path;
+	m_FrameSize = 0;
+	for (uint32_t i = 0; i < s_NumPlanes; ++i) {
+		m_RowBytes[i] = p_RowBytes[i];
+		m_NumRows[i] = p_NumRows[i];
+		m_PlaneOffsets[i] = m_FrameSize;
+		m_FrameSize += static_cast<uint64_t>(p_RowBytes[i]) * p_NumRows[i];
+	}
+	m_MaxBytes = p_MaxBytes;
+	m_PTS.clear();
+	m_HasFailed = false;
+	m_IsOverBudget = false;
+
+	if ((m_FrameSize == 0) || !m_Writer.Open(m_Path)) {
+		m_HasFailed = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool FrameCache::Add(const uint8_t* const p_pPlanes[s_NumPlanes], const uint32_t p_Strides[s_NumPlanes], int64_t p_PTS)
+{
+	if (m_HasFailed) {
+		return false;
+	}
+
+	if ((GetNumBytes() + m_FrameSize) > m_MaxBytes) {
+		m_IsOverBudget = true;
+		m_HasFailed = true;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < s_NumPlanes; ++i) {
+		// rows of a plane without padding are one write, otherwise the writer gathers them
+		if (p_Strides[i] == m_RowBytes[i]) {
+			if (!m_Writer.Write(p_pPlanes[i], static_cast<size_t>(m_RowBytes[i]) * m_NumRows[i])) {
+				m_HasFailed = true;
+				return false;
+			}
+			continue;
+		}
+
+		const uint8_t* pRow = p_pPlanes[i];
+		for (uint32_t row = 0; row < m_NumRows[i]; ++row) {
+			if (!m_Writer.Write(pRow, m_RowBytes[i])) {
+				m_HasFailed = true;
+				return false;
+			}
+			pRow += p_Strides[i];
+		}
+	}
+
+	m_PTS.push_back(p_PTS);
+	return true;
+}
+
+bool FrameCache::Finish()
+{
+	// a spool read by both passes is mapped once
+	if (m_pMapping != NULL) {
+		return true;
+	}
+
+	if (m_HasFailed || !m_Writer.Close()) {
+		m_HasFailed = true;
+		return false;
+	}
+
+	if (!Map()) {
+		m_HasFailed = true;
+		return false;
+	}
+
+	return true;
+}
+
+void FrameCache::Close()
+{
+	Unmap();
+	m_Writer.Close();
+
+	if (!m_Path.empty()) {
+		std::error_code err;
+		std::filesystem::remove(m_Path, err);
+		m_Path.clear();
+	}
+	m_PTS.clear();
+}
+
+bool FrameCache::Map()
+{
+	m_MappingSize = GetNumBytes();
+	if (m_MappingSize == 0) {
+		return true;
+	}
+
+#if defined(_WIN32)
+	m_hFile = CreateFileA(m_Path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping == NULL) {
+		Unmap();
+		return false;
+	}
+
+	m_pMapping = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_pMapping == NULL) {
+		Unmap();
+		return false;
+	}
+#else
+	const int fd = open(m_Path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	void* pMapping = mmap(NULL, m_MappingSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pMapping == MAP_FAILED) {
+		return false;
+	}
+
+	// the final pass reads the frames once and in order
+	madvise(pMapping, m_MappingSize, MADV_SEQUENTIAL);
+	m_pMapping = static_cast<const uint8_t*>(pMapping);
+#endif
+
+	return true;
+}
+
+void FrameCache::Unmap()
+{
+#if defined(_WIN32)
+	if (m_pMapping != NULL) {
+		UnmapViewOfFile(m_pMapping);
+	}
+	if (m_hMapping != NULL) {
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pMapping != NULL) {
+		munmap(const_cast<uint8_t*>(m_pMapping), m_MappingSize);
+	}
+#endif
+
+	m_pMapping = NULL;
+	m_MappingSize = 0;
+}
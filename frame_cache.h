@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "file_writer.h"
+
+// Spool of the x265 input pictures of the first pass. Every frame is stored as its three planes with
+// packed rows, the timestamps stay in memory. Once the spool is finished the file is memory mapped and
+// the final pass hands the planes to x265 in place, so the host does not render the timeline twice.
+class FrameCache
+{
+public:
+	static const uint32_t s_NumPlanes = 3;
+
+public:
+	FrameCache();
+	~FrameCache();
+
+	// true for a folder on tmpfs or ramfs, a spool there would hold the whole timeline in memory
+	static bool IsMemoryBacked(const std::string& p_Folder);
+
+	// p_RowBytes and p_NumRows per plane, p_MaxBytes is the disk budget of the spool
+	bool Create(const std::string& p_Path, const uint32_t p_RowBytes[s_NumPlanes], const uint32_t p_NumRows[s_NumPlanes], uint64_t p_MaxBytes);
+	// false once the budget is used up or a write failed, the spool is abandoned then
+	bool Add(const uint8_t* const p_pPlanes[s_NumPlanes], const uint32_t p_Strides[s_NumPlanes], int64_t p_PTS);
+	// closes the spool and maps it for reading, a finished spool stays mapped
+	bool Finish();
+	// unmaps and deletes the spool
+	void Close();
+
+	bool HasFailed() const
+	{
+		return m_HasFailed;
+	}
+
+	bool IsOverBudget() const
+	{
+		return m_IsOverBudget;
+	}
+
+	const std::string& GetPath() const
+	{
+		return m_Path;
+	}
+
+	uint64_t GetNumFrames() const
+	{
+		return m_PTS.size();
+	}
+
+	uint64_t GetFrameSize() const
+	{
+		return m_FrameSize;
+	}
+
+	uint64_t GetNumBytes() const
+	{
+		return m_FrameSize * m_PTS.size();
+	}
+
+	// time spent writing the spool
+	double GetWriteSeconds() const
+	{
+		return m_Writer.GetWriteSeconds();
+	}
+
+	int64_t GetPTS(uint64_t p_FrameIdx) const
+	{
+		return m_PTS[p_FrameIdx];
+	}
+
+	// valid after Finish()
+	const uint8_t* GetPlane(uint64_t p_FrameIdx, uint32_t p_PlaneIdx) const
+	{
+		return m_pMapping + p_FrameIdx * m_FrameSize + m_PlaneOffsets[p_PlaneIdx];
+	}
+
+	uint32_t GetStride(uint32_t p_PlaneIdx) const
+	{
+		return m_RowBytes[p_PlaneIdx];
+	}
+
+private:
+	FrameCache(const FrameCache& p_Other);
+	FrameCache& operator=(const FrameCache& p_Other);
+
+	bool Map();
+	void Unmap();
+
+private:
+	std::string m_Path;
+	BufferedFileWriter m_Writer;
+	uint32_t m_RowBytes[s_NumPlanes];
+	uint32_t m_NumRows[s_NumPlanes];
+	uint64_t m_PlaneOffsets[s_NumPlanes];
+	uint64_t m_FrameSize;
+	uint64_t m_MaxBytes;
+	std::vector<int64_t> m_PTS;
+	bool m_HasFailed;
+	bool m_IsOverBudget;
+
+	const uint8_t* m_pMapping;
+	uint64_t m_MappingSize;
+#if defined(_WIN32)
+	void* m_hFile;
+	void* m_hMapping;
+#endif
+};
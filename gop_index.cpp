@@ -0,0 +1,157 @@
+#include "gop_index.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "x265.h"
+
+const uint32_t GOPIndexWriter::s_Version = 1;
+const uint32_t GOPIndexWriter::s_RecordSize = 40;
+const uint8_t GOPIndexWriter::s_FlagRandomAccess = 1;
+
+static const size_t s_HeaderSize = 32;
+static const size_t s_CountOffset = 16;
+static const size_t s_IndexBufferSize = 256 << 10;
+
+// the index is read on any machine, the byte order is fixed rather than taken from the host
+static uint8_t* s_PutLE(uint8_t* p_pOut, uint64_t p_Value, uint32_t p_NumBytes)
+{
+	for (uint32_t i = 0; i < p_NumBytes; ++i) {
+		p_pOut[i] = static_cast<uint8_t>(p_Value >> (8 * i));
+	}
+
+	return p_pOut + p_NumBytes;
+}
+
+static const char* s_GetSliceTypeName(int p_SliceType)
+{
+	switch (p_SliceType) {
+	case X265_TYPE_IDR:
+		return "IDR";
+	case X265_TYPE_I:
+		return "I";
+	case X265_TYPE_P:
+		return "P";
+	case X265_TYPE_BREF:
+		return "BREF";
+	case X265_TYPE_B:
+		return "B";
+	default:
+		break;
+	}
+
+	return "AUTO";
+}
+
+GOPIndexWriter::GOPIndexWriter()
+	: m_Binary(s_IndexBufferSize)
+	, m_JSON(s_IndexBufferSize)
+	, m_Offset(0)
+	, m_NumRecords(0)
+	, m_NumRandomAccess(0)
+	, m_HasFailed(false)
+{
+}
+
+GOPIndexWriter::~GOPIndexWriter()
+{
+	Close();
+}
+
+bool GOPIndexWriter::Open(const std::string& p_Path, uint32_t p_FPSNum, uint32_t p_FPSDen, uint64_t p_HeaderBytes)
+{
+	if (!m_Binary.Open(p_Path) || !m_JSON.Open(p_Path + ".json")) {
+		m_Binary.Close();
+		m_JSON.Close();
+		return false;
+	}
+
+	m_Offset = p_HeaderBytes;
+	m_NumRecords = 0;
+	m_NumRandomAccess = 0;
+	m_HasFailed = false;
+
+	uint8_t header[s_HeaderSize];
+	memcpy(header, "X265GIDX", 8);
+	uint8_t* pOut = s_PutLE(header + 8, s_Version, 4);
+	pOut = s_PutLE(pOut, s_RecordSize, 4);
+	pOut = s_PutLE(pOut, 0, 8);
+	pOut = s_PutLE(pOut, p_FPSNum, 4);
+	s_PutLE(pOut, p_FPSDen, 4);
+
+	char json[128];
+	const int jsonSize = snprintf(json, sizeof(json), "{\"version\":%u,\"fps\":[%u,%u],\"frames\":[", s_Version, p_FPSNum, p_FPSDen);
+
+	m_HasFailed = !m_Binary.Write(header, sizeof(header)) || !m_JSON.Write(json, jsonSize);
+	return !m_HasFailed;
+}
+
+bool GOPIndexWriter::Add(const uint8_t* p_pData, size_t p_Size, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsRandomAccess)
+{
+	if (!IsOpen() || m_HasFailed) {
+		return false;
+	}
+
+	// coded slice NALs (types 0..31) carry the picture bits, the rest is parameter sets and SEI
+	uint64_t sliceBytes = 0;
+	size_t pos = 0;
+	while (pos + 5 <= p_Size) {
+		const size_t nalSize = (static_cast<size_t>(p_pData[pos]) << 24) | (static_cast<size_t>(p_pData[pos + 1]) << 16) |
+							   (static_cast<size_t>(p_pData[pos + 2]) << 8) | p_pData[pos + 3];
+		if ((nalSize == 0) || (nalSize > p_Size - pos - 4)) {
+			break;
+		}
+
+		if (((p_pData[pos + 4] >> 1) & 0x3f) < 32) {
+			sliceBytes += nalSize;
+		}
+		pos += 4 + nalSize;
+	}
+
+	const uint8_t flags = p_IsRandomAccess ? s_FlagRandomAccess : 0;
+	const uint32_t bits = static_cast<uint32_t>(sliceBytes * 8);
+
+	uint8_t record[s_RecordSize];
+	memset(record, 0, sizeof(record));
+	uint8_t* pOut = s_PutLE(record, m_Offset, 8);
+	pOut = s_PutLE(pOut, static_cast<uint64_t>(p_PTS), 8);
+	pOut = s_PutLE(pOut, static_cast<uint64_t>(p_DTS), 8);
+	pOut = s_PutLE(pOut, p_Size, 4);
+	pOut = s_PutLE(pOut, bits, 4);
+	pOut = s_PutLE(pOut, static_cast<uint8_t>(p_SliceType), 1);
+	s_PutLE(pOut, flags, 1);
+
+	char json[256];
+	const int jsonSize = snprintf(json, sizeof(json), "%s\n{\"offset\":%" PRIu64 ",\"size\":%zu,\"pts\":%" PRId64 ",\"dts\":%" PRId64 ",\"type\":\"%s\",\"bits\":%u,\"rap\":%s}",
+		(m_NumRecords > 0) ? "," : "", m_Offset, p_Size, p_PTS, p_DTS, s_GetSliceTypeName(p_SliceType), bits, p_IsRandomAccess ? "true" : "false");
+
+	if (!m_Binary.Write(record, sizeof(record)) || !m_JSON.Write(json, jsonSize)) {
+		m_HasFailed = true;
+		return false;
+	}
+
+	m_Offset += p_Size;
+	++m_NumRecords;
+	if (p_IsRandomAccess) {
+		++m_NumRandomAccess;
+	}
+
+	return true;
+}
+
+bool GOPIndexWriter::Close()
+{
+	if (!IsOpen()) {
+		return true;
+	}
+
+	uint8_t count[8];
+	s_PutLE(count, m_NumRecords, 8);
+
+	const char jsonEnd[] = "\n]}\n";
+	bool isOk = !m_HasFailed && m_Binary.WriteAt(s_CountOffset, count, sizeof(count)) && m_JSON.Write(jsonEnd, sizeof(jsonEnd) - 1);
+
+	isOk = m_Binary.Close() && isOk;
+	isOk = m_JSON.Close() && isOk;
+	return isOk;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "file_writer.h"
+
+// Access unit index of the .hevc elementary stream, written while the final pass runs so packaging tools
+// can find random access points and split or seek without parsing the bitstream. Two forms are written:
+//
+// <path>.idx       little-endian binary, a 32 byte header then one 40 byte record per access unit
+//                  header:  "X265GIDX", u32 version, u32 record size, u64 record count, u32 fps num, u32 fps den
+//                  record:  u64 offset, i64 pts, i64 dts, u32 size, u32 bits, u8 slice type, u8 flags, 6 reserved
+// <path>.idx.json  the same records as a JSON array
+//
+// Offsets count from the start of the .hevc file, parameter sets included. They do not address the
+// container of the export, which lays the access units out on its own. Bits are the coded slice data of the
+// access unit, size is the whole access unit. Flag 1 marks a random access point.
+class GOPIndexWriter
+{
+public:
+	static const uint32_t s_Version;
+	static const uint32_t s_RecordSize;
+	static const uint8_t s_FlagRandomAccess;
+
+public:
+	GOPIndexWriter();
+	~GOPIndexWriter();
+
+	// p_HeaderBytes is the size of the parameter sets in front of the first access unit
+	bool Open(const std::string& p_Path, uint32_t p_FPSNum, uint32_t p_FPSDen, uint64_t p_HeaderBytes);
+	// p_pData holds the access unit as NALs with 4 byte lengths, p_SliceType is an X265_TYPE_* value
+	bool Add(const uint8_t* p_pData, size_t p_Size, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsRandomAccess);
+	// writes the record count into the header and terminates the JSON array
+	bool Close();
+
+	bool IsOpen() const
+	{
+		return m_Binary.IsOpen();
+	}
+
+	uint64_t GetNumRecords() const
+	{
+		return m_NumRecords;
+	}
+
+	uint64_t GetNumRandomAccess() const
+	{
+		return m_NumRandomAccess;
+	}
+
+private:
+	GOPIndexWriter(const GOPIndexWriter& p_Other);
+	GOPIndexWriter& operator=(const GOPIndexWriter& p_Other);
+
+private:
+	BufferedFileWriter m_Binary;
+	BufferedFileWriter m_JSON;
+	uint64_t m_Offset;
+	uint64_t m_NumRecords;
+	uint64_t m_NumRandomAccess;
+	bool m_HasFailed;
+};
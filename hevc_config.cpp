@@ -0,0 +1,225 @@
+#include "hevc_config.h"
+
+static const uint8_t s_NalTypeVPS = 32;
+static const uint8_t s_NalTypeSPS = 33;
+static const uint8_t s_NalTypePPS = 34;
+
+class BitReader
+{
+public:
+	explicit BitReader(const std::vector<uint8_t>& p_Data)
+		: m_Data(p_Data)
+		, m_BitPos(0)
+	{
+	}
+
+	uint32_t ReadBits(uint32_t p_NumBits)
+	{
+		uint32_t val = 0;
+		for (uint32_t i = 0; i < p_NumBits; ++i) {
+			val = (val << 1) | ReadBit();
+		}
+
+		return val;
+	}
+
+	void SkipBits(size_t p_NumBits)
+	{
+		m_BitPos += p_NumBits;
+	}
+
+	uint32_t ReadUE()
+	{
+		uint32_t numZeros = 0;
+		while ((ReadBit() == 0) && !IsOverrun() && (numZeros < 32)) {
+			++numZeros;
+		}
+
+		return ((1u << numZeros) - 1) + ReadBits(numZeros);
+	}
+
+	bool IsOverrun() const
+	{
+		return (m_BitPos > (m_Data.size() * 8));
+	}
+
+private:
+	uint32_t ReadBit()
+	{
+		const size_t bytePos = m_BitPos >> 3;
+		const uint32_t bit = (bytePos < m_Data.size()) ? ((m_Data[bytePos] >> (7 - (m_BitPos & 7))) & 1) : 0;
+		++m_BitPos;
+		return bit;
+	}
+
+private:
+	const std::vector<uint8_t>& m_Data;
+	size_t m_BitPos;
+};
+
+struct SPSInfo
+{
+	uint8_t profileTierByte; // profile_space(2) tier(1) profile_idc(5)
+	uint8_t profileCompatibility[4];
+	uint8_t constraintFlags[6];
+	uint8_t levelIdc;
+	uint8_t numTemporalLayers;
+	uint8_t temporalIdNested;
+	uint8_t chromaFormatIdc;
+	uint8_t bitDepthLumaMinus8;
+	uint8_t bitDepthChromaMinus8;
+};
+
+// RBSP of the NAL payload behind the 2 byte header, emulation prevention bytes removed
+static void s_ExtractRBSP(const HEVCNalRef& p_Nal, std::vector<uint8_t>* p_pRBSP)
+{
+	p_pRBSP->clear();
+	p_pRBSP->reserve(p_Nal.size);
+
+	uint32_t numZeros = 0;
+	for (size_t i = 2; i < p_Nal.size; ++i) {
+		const uint8_t byte = p_Nal.pData[i];
+		if ((numZeros >= 2) && (byte == 0x03)) {
+			numZeros = 0;
+			continue;
+		}
+
+		numZeros = (byte == 0) ? (numZeros + 1) : 0;
+		p_pRBSP->push_back(byte);
+	}
+}
+
+static bool s_ParseSPS(const HEVCNalRef& p_Nal, SPSInfo* p_pInfo)
+{
+	std::vector<uint8_t> rbsp;
+	s_ExtractRBSP(p_Nal, &rbsp);
+
+	BitReader reader(rbsp);
+
+	reader.SkipBits(4); // sps_video_parameter_set_id
+	const uint32_t maxSubLayersMinus1 = reader.ReadBits(3);
+	p_pInfo->numTemporalLayers = static_cast<uint8_t>(maxSubLayersMinus1 + 1);
+	p_pInfo->temporalIdNested = static_cast<uint8_t>(reader.ReadBits(1));
+
+	// profile_tier_level: general part is byte aligned at this point
+	p_pInfo->profileTierByte = static_cast<uint8_t>(reader.ReadBits(8));
+	for (int i = 0; i < 4; ++i) {
+		p_pInfo->profileCompatibility[i] = static_cast<uint8_t>(reader.ReadBits(8));
+	}
+	for (int i = 0; i < 6; ++i) {
+		p_pInfo->constraintFlags[i] = static_cast<uint8_t>(reader.ReadBits(8));
+	}
+	p_pInfo->levelIdc = static_cast<uint8_t>(reader.ReadBits(8));
+
+	bool subLayerProfilePresent[8] = {};
+	bool subLayerLevelPresent[8] = {};
+	for (uint32_t i = 0; i < maxSubLayersMinus1; ++i) {
+		subLayerProfilePresent[i] = (reader.ReadBits(1) != 0);
+		subLayerLevelPresent[i] = (reader.ReadBits(1) != 0);
+	}
+	if (maxSubLayersMinus1 > 0) {
+		reader.SkipBits(2 * (8 - maxSubLayersMinus1));
+	}
+	for (uint32_t i = 0; i < maxSubLayersMinus1; ++i) {
+		if (subLayerProfilePresent[i]) {
+			reader.SkipBits(88);
+		}
+		if (subLayerLevelPresent[i]) {
+			reader.SkipBits(8);
+		}
+	}
+
+	reader.ReadUE(); // sps_seq_parameter_set_id
+	p_pInfo->chromaFormatIdc = static_cast<uint8_t>(reader.ReadUE());
+	if (p_pInfo->chromaFormatIdc == 3) {
+		reader.SkipBits(1); // separate_colour_plane_flag
+	}
+
+	reader.ReadUE(); // pic_width_in_luma_samples
+	reader.ReadUE(); // pic_height_in_luma_samples
+	if (reader.ReadBits(1) != 0) { // conformance_window_flag
+		for (int i = 0; i < 4; ++i) {
+			reader.ReadUE();
+		}
+	}
+
+	p_pInfo->bitDepthLumaMinus8 = static_cast<uint8_t>(reader.ReadUE());
+	p_pInfo->bitDepthChromaMinus8 = static_cast<uint8_t>(reader.ReadUE());
+
+	return !reader.IsOverrun() && (p_pInfo->chromaFormatIdc <= 3) && (p_pInfo->bitDepthLumaMinus8 <= 8) && (p_pInfo->bitDepthChromaMinus8 <= 8);
+}
+
+static void s_Write16(std::vector<uint8_t>* p_pOut, uint32_t p_Val)
+{
+	p_pOut->push_back(static_cast<uint8_t>(p_Val >> 8));
+	p_pOut->push_back(static_cast<uint8_t>(p_Val));
+}
+
+bool g_BuildHEVCDecoderConfig(const std::vector<HEVCNalRef>& p_Nals, std::vector<uint8_t>* p_pRecord)
+{
+	const uint8_t arrayTypes[] = { s_NalTypeVPS, s_NalTypeSPS, s_NalTypePPS };
+
+	const HEVCNalRef* pSPS = NULL;
+	for (const HEVCNalRef& nal : p_Nals) {
+		if ((nal.size > 2) && (((nal.pData[0] >> 1) & 0x3F) == s_NalTypeSPS)) {
+			pSPS = &nal;
+			break;
+		}
+	}
+
+	SPSInfo sps;
+	if ((pSPS == NULL) || !s_ParseSPS(*pSPS, &sps)) {
+		return false;
+	}
+
+	std::vector<uint8_t>& rec = *p_pRecord;
+	rec.clear();
+
+	rec.push_back(1); // configurationVersion
+	rec.push_back(sps.profileTierByte);
+	rec.insert(rec.end(), sps.profileCompatibility, sps.profileCompatibility + 4);
+	rec.insert(rec.end(), sps.constraintFlags, sps.constraintFlags + 6);
+	rec.push_back(sps.levelIdc);
+	s_Write16(&rec, 0xF000); // reserved, min_spatial_segmentation_idc 0
+	rec.push_back(0xFC); // reserved, parallelismType 0 (unknown)
+	rec.push_back(static_cast<uint8_t>(0xFC | sps.chromaFormatIdc));
+	rec.push_back(static_cast<uint8_t>(0xF8 | sps.bitDepthLumaMinus8));
+	rec.push_back(static_cast<uint8_t>(0xF8 | sps.bitDepthChromaMinus8));
+	s_Write16(&rec, 0); // avgFrameRate unspecified
+	// constantFrameRate 0, numTemporalLayers, temporalIdNested, lengthSizeMinusOne 3
+	rec.push_back(static_cast<uint8_t>(((sps.numTemporalLayers & 0x7) << 3) | ((sps.temporalIdNested & 1) << 2) | 3));
+
+	const size_t numArraysPos = rec.size();
+	rec.push_back(0);
+
+	uint8_t numArrays = 0;
+	for (uint8_t type : arrayTypes) {
+		const size_t numNalusPos = rec.size() + 1;
+		uint32_t numNalus = 0;
+
+		for (const HEVCNalRef& nal : p_Nals) {
+			if ((nal.size < 2) || (((nal.pData[0] >> 1) & 0x3F) != type) || (nal.size > 0xFFFF)) {
+				continue;
+			}
+
+			if (numNalus == 0) {
+				rec.push_back(static_cast<uint8_t>(0x80 | type)); // array_completeness 1
+				s_Write16(&rec, 0);
+			}
+
+			s_Write16(&rec, static_cast<uint32_t>(nal.size));
+			rec.insert(rec.end(), nal.pData, nal.pData + nal.size);
+			++numNalus;
+		}
+
+		if (numNalus > 0) {
+			rec[numNalusPos] = static_cast<uint8_t>(numNalus >> 8);
+			rec[numNalusPos + 1] = static_cast<uint8_t>(numNalus);
+			++numArrays;
+		}
+	}
+
+	rec[numArraysPos] = numArrays;
+
+	return (numArrays == 3);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// one NAL unit without start code or length prefix, p_pData starts with the 2 byte NAL header
+struct HEVCNalRef
+{
+	const uint8_t* pData;
+	size_t size;
+};
+
+// HEVCDecoderConfigurationRecord (ISO/IEC 14496-15 8.3.3) from the VPS / SPS / PPS of the stream,
+// the profile, level and format fields are taken from the first SPS. NALs are length prefixed with 4 bytes.
+bool g_BuildHEVCDecoderConfig(const std::vector<HEVCNalRef>& p_Nals, std::vector<uint8_t>* p_pRecord);
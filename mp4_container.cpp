@@ -0,0 +1,1046 @@
+#include "mp4_container.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+const uint8_t MP4Container::s_UUID[] = { 0x93, 0x18, 0x43, 0xe8, 0x42, 0xa3, 0x42, 0x26, 0x97, 0x12, 0xfa, 0x01, 0xe8, 0xd2, 0x6d, 0xe3 };
+
+// encoder UI value forwarded with the codec properties, uint8_t 1 - write the moov in front of the mdat
+static const char* s_pFastStartKey = "x265_mp4_faststart";
+// int32_t 0 - single moov at the end (or front with faststart), 1 - fragmented / CMAF
+static const char* s_pLayoutKey = "x265_mp4_layout";
+// int32_t target fragment duration in seconds
+static const char* s_pFragmentDurationKey = "x265_mp4_frag_dur";
+
+// trun sample flags: sync sample depending on nothing, non-sync sample depending on others
+static const uint32_t s_SyncSampleFlags = 0x02000000;
+static const uint32_t s_NonSyncSampleFlags = 0x01010000;
+
+// samples of one track written back to back are grouped into chunks of at most this many samples,
+// a fixed count keeps the stsc at one or two entries
+static const uint32_t s_MaxChunkSamples = 32;
+
+static const uint32_t s_Matrix[] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+// serializes big-endian box fields, box sizes are patched when the box is closed
+class MP4BoxBuilder
+{
+public:
+	explicit MP4BoxBuilder(std::vector<uint8_t>* p_pOut)
+		: m_pOut(p_pOut)
+	{
+	}
+
+	void PutU8(uint8_t p_Val)
+	{
+		m_pOut->push_back(p_Val);
+	}
+
+	void PutU16(uint16_t p_Val)
+	{
+		PutU8(static_cast<uint8_t>(p_Val >> 8));
+		PutU8(static_cast<uint8_t>(p_Val));
+	}
+
+	void PutU32(uint32_t p_Val)
+	{
+		PutU16(static_cast<uint16_t>(p_Val >> 16));
+		PutU16(static_cast<uint16_t>(p_Val));
+	}
+
+	void PutU64(uint64_t p_Val)
+	{
+		PutU32(static_cast<uint32_t>(p_Val >> 32));
+		PutU32(static_cast<uint32_t>(p_Val));
+	}
+
+	void PutZeros(size_t p_Count)
+	{
+		m_pOut->insert(m_pOut->end(), p_Count, 0);
+	}
+
+	void PutBytes(const uint8_t* p_pData, size_t p_Size)
+	{
+		m_pOut->insert(m_pOut->end(), p_pData, p_pData + p_Size);
+	}
+
+	size_t BeginBox(uint32_t p_Type)
+	{
+		const size_t start = m_pOut->size();
+		PutU32(0);
+		PutU32(p_Type);
+		return start;
+	}
+
+	size_t BeginFullBox(uint32_t p_Type, uint8_t p_Version, uint32_t p_Flags)
+	{
+		const size_t start = BeginBox(p_Type);
+		PutU32((static_cast<uint32_t>(p_Version) << 24) | (p_Flags & 0xffffff));
+		return start;
+	}
+
+	void EndBox(size_t p_Start)
+	{
+		const uint32_t size = static_cast<uint32_t>(m_pOut->size() - p_Start);
+		uint8_t* pSize = &(*m_pOut)[p_Start];
+		pSize[0] = static_cast<uint8_t>(size >> 24);
+		pSize[1] = static_cast<uint8_t>(size >> 16);
+		pSize[2] = static_cast<uint8_t>(size >> 8);
+		pSize[3] = static_cast<uint8_t>(size);
+	}
+
+	void PutMatrix()
+	{
+		for (uint32_t val : s_Matrix) {
+			PutU32(val);
+		}
+	}
+
+private:
+	std::vector<uint8_t>* m_pOut;
+};
+
+static void s_BuildFileType(bool p_IsFragmented, std::vector<uint8_t>* p_pOut)
+{
+	MP4BoxBuilder box(p_pOut);
+	const size_t ftyp = box.BeginBox('ftyp');
+	if (p_IsFragmented) {
+		// iso6 covers tfdt and the signed trun offsets, cmfc marks CMAF conformance
+		box.PutU32('iso6');
+		box.PutU32(0);
+		box.PutU32('iso6');
+		box.PutU32('cmfc');
+		box.PutU32('isom');
+		box.PutU32('mp41');
+	} else {
+		// iso4 covers the signed composition offsets, co64 is part of the base brand
+		box.PutU32('isom');
+		box.PutU32(0x200);
+		box.PutU32('isom');
+		box.PutU32('iso4');
+		box.PutU32('mp41');
+	}
+	box.EndBox(ftyp);
+}
+
+static void s_AppendRun(std::vector<MP4SampleRun>* p_pRuns, int64_t p_Value)
+{
+	if (!p_pRuns->empty() && (p_pRuns->back().value == p_Value) && (p_pRuns->back().count < UINT32_MAX)) {
+		++p_pRuns->back().count;
+		return;
+	}
+
+	MP4SampleRun run;
+	run.count = 1;
+	run.value = p_Value;
+	p_pRuns->push_back(run);
+}
+
+static void s_CloseChunk(MP4TrackTable* p_pTrack)
+{
+	if (p_pTrack->chunkSamples == 0) {
+		return;
+	}
+
+	if (p_pTrack->chunkRuns.empty() || (p_pTrack->chunkRuns.back().samplesPerChunk != p_pTrack->chunkSamples)) {
+		MP4ChunkRun run;
+		run.firstChunk = static_cast<uint32_t>(p_pTrack->chunkOffsets.size());
+		run.samplesPerChunk = p_pTrack->chunkSamples;
+		p_pTrack->chunkRuns.push_back(run);
+	}
+
+	p_pTrack->chunkSamples = 0;
+}
+
+static uint64_t s_GetMediaDuration(const MP4TrackTable& p_Track)
+{
+	return p_Track.hasSamples ? static_cast<uint64_t>(p_Track.decodeTime + p_Track.lastDelta) : 0;
+}
+
+static uint64_t s_Rescale(uint64_t p_Val, uint32_t p_From, uint32_t p_To)
+{
+	return (p_From == p_To) ? p_Val : static_cast<uint64_t>((static_cast<double>(p_Val) * p_To) / p_From + 0.5);
+}
+
+static bool s_GetUINT32Pair(IPropertyProvider* p_pProps, PropertyID p_ID, uint32_t& p_First, uint32_t& p_Second)
+{
+	PropertyType propType = propTypeNull;
+	const void* pVal = NULL;
+	int numVals = 0;
+	if ((p_pProps->GetProperty(p_ID, &propType, &pVal, &numVals) != errNone) || (propType != propTypeUInt32) || (numVals != 2)) {
+		return false;
+	}
+
+	const uint32_t* pPair = static_cast<const uint32_t*>(pVal);
+	if ((pPair[0] == 0) || (pPair[1] == 0)) {
+		return false;
+	}
+
+	p_First = pPair[0];
+	p_Second = pPair[1];
+	return true;
+}
+
+static void s_BuildSampleTable(const MP4TrackTable& p_Track, uint64_t p_OffsetShift, MP4BoxBuilder* p_pBox)
+{
+	MP4BoxBuilder& box = *p_pBox;
+
+	const size_t stbl = box.BeginBox('stbl');
+
+	{
+		const size_t stsd = box.BeginFullBox('stsd', 0, 0);
+		box.PutU32(1);
+
+		const size_t hvc1 = box.BeginBox('hvc1');
+		box.PutZeros(6);
+		box.PutU16(1); // data reference index
+		box.PutZeros(16);
+		box.PutU16(static_cast<uint16_t>(p_Track.width));
+		box.PutU16(static_cast<uint16_t>(p_Track.height));
+		box.PutU32(0x00480000);
+		box.PutU32(0x00480000);
+		box.PutU32(0);
+		box.PutU16(1); // frame count
+		box.PutZeros(32); // compressor name
+		box.PutU16(0x0018);
+		box.PutU16(0xffff);
+
+		const size_t hvcC = box.BeginBox('hvcC');
+		box.PutBytes(p_Track.decoderConfig.data(), p_Track.decoderConfig.size());
+		box.EndBox(hvcC);
+
+		if (std::fabs(p_Track.par - 1.0) > 0.0001) {
+			const size_t pasp = box.BeginBox('pasp');
+			box.PutU32(static_cast<uint32_t>(std::lround(p_Track.par * 10000)));
+			box.PutU32(10000);
+			box.EndBox(pasp);
+		}
+
+		box.EndBox(hvc1);
+		box.EndBox(stsd);
+	}
+
+	{
+		const size_t stts = box.BeginFullBox('stts', 0, 0);
+		box.PutU32(static_cast<uint32_t>(p_Track.timeToSample.size()));
+		for (const MP4SampleRun& run : p_Track.timeToSample) {
+			box.PutU32(run.count);
+			box.PutU32(static_cast<uint32_t>(run.value));
+		}
+		box.EndBox(stts);
+	}
+
+	// without reordering every offset is zero and the box is left out
+	if ((p_Track.compositionOffsets.size() > 1) || (!p_Track.compositionOffsets.empty() && (p_Track.compositionOffsets[0].value != 0))) {
+		const size_t ctts = box.BeginFullBox('ctts', p_Track.hasNegativeOffsets ? 1 : 0, 0);
+		box.PutU32(static_cast<uint32_t>(p_Track.compositionOffsets.size()));
+		for (const MP4SampleRun& run : p_Track.compositionOffsets) {
+			box.PutU32(run.count);
+			box.PutU32(static_cast<uint32_t>(static_cast<int32_t>(run.value)));
+		}
+		box.EndBox(ctts);
+	}
+
+	// an all intra stream has no stss
+	if (p_Track.syncSamples.size() < p_Track.sizes.size()) {
+		const size_t stss = box.BeginFullBox('stss', 0, 0);
+		box.PutU32(static_cast<uint32_t>(p_Track.syncSamples.size()));
+		for (uint32_t sampleNum : p_Track.syncSamples) {
+			box.PutU32(sampleNum);
+		}
+		box.EndBox(stss);
+	}
+
+	{
+		const size_t stsc = box.BeginFullBox('stsc', 0, 0);
+		box.PutU32(static_cast<uint32_t>(p_Track.chunkRuns.size()));
+		for (const MP4ChunkRun& run : p_Track.chunkRuns) {
+			box.PutU32(run.firstChunk);
+			box.PutU32(run.samplesPerChunk);
+			box.PutU32(1);
+		}
+		box.EndBox(stsc);
+	}
+
+	{
+		const size_t stsz = box.BeginFullBox('stsz', 0, 0);
+		box.PutU32(0);
+		box.PutU32(static_cast<uint32_t>(p_Track.sizes.size()));
+		for (uint32_t size : p_Track.sizes) {
+			box.PutU32(size);
+		}
+		box.EndBox(stsz);
+	}
+
+	{
+		const size_t co64 = box.BeginFullBox('co64', 0, 0);
+		box.PutU32(static_cast<uint32_t>(p_Track.chunkOffsets.size()));
+		for (uint64_t offset : p_Track.chunkOffsets) {
+			box.PutU64(offset + p_OffsetShift);
+		}
+		box.EndBox(co64);
+	}
+
+	box.EndBox(stbl);
+}
+
+MP4Container::MP4Container()
+	: m_pLastTrack(NULL)
+	, m_MediaDataStart(0)
+	, m_IsFastStart(false)
+	, m_IsFragmented(false)
+	, m_FragmentDuration(2.0)
+	, m_FragmentSequence(0)
+	, m_MaxFragmentBytes(0)
+	, m_FragmentSeconds(0)
+	, m_IsClosed(false)
+	, m_NumSamples(0)
+	, m_Error(errNone)
+{
+}
+
+MP4Container::~MP4Container()
+{
+	Cleanup();
+}
+
+void MP4Container::Cleanup()
+{
+	if (m_IsClosed) {
+		return;
+	}
+
+	// the host gave up on the render, a half relocated file is of no use
+	m_Writer.Close();
+	if (m_IsFastStart && !m_WritePath.empty()) {
+		std::error_code errCode;
+		std::filesystem::remove(m_WritePath, errCode);
+	}
+}
+
+std::string MP4Container::s_GetUUIDString()
+{
+	static const char* pHexDigits = "0123456789abcdef";
+
+	std::string uuidStr;
+	for (int i = 0; i < 16; ++i) {
+		uuidStr.push_back(pHexDigits[s_UUID[i] >> 4]);
+		uuidStr.push_back(pHexDigits[s_UUID[i] & 0x0f]);
+	}
+
+	return uuidStr;
+}
+
+bool MP4Container::s_IsSelected(const std::string& p_Container)
+{
+	const std::string uuidStr = s_GetUUIDString();
+	if (p_Container.size() != uuidStr.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < uuidStr.size(); ++i) {
+		if (std::tolower(static_cast<unsigned char>(p_Container[i])) != uuidStr[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+StatusCode MP4Container::s_Register(HostListRef* p_pList)
+{
+	HostPropertyCollectionRef containerInfo;
+	if (!containerInfo.IsValid()) {
+		return errAlloc;
+	}
+
+	containerInfo.SetProperty(pIOPropUUID, propTypeUInt8, s_UUID, 16);
+
+	const char* pContainerName = "X265 MP4";
+	containerInfo.SetProperty(pIOPropName, propTypeString, pContainerName, static_cast<int>(strlen(pContainerName)));
+
+	const char* pContainerExt = "mp4";
+	containerInfo.SetProperty(pIOPropContainerExt, propTypeString, pContainerExt, static_cast<int>(strlen(pContainerExt)));
+
+	// HEVC video only, the x265 codec entries list this container by its UUID
+	uint32_t vMediaVideo = mediaVideo;
+	containerInfo.SetProperty(pIOPropMediaType, propTypeUInt32, &vMediaVideo, 1);
+
+	if (!p_pList->Append(&containerInfo)) {
+		return errFail;
+	}
+
+	return errNone;
+}
+
+StatusCode MP4Container::DoInit(HostPropertyCollectionRef* p_pProps)
+{
+	g_Log(logLevelInfo, "X265 Plugin :: MP4 :: DoInit");
+
+	return errNone;
+}
+
+StatusCode MP4Container::DoOpen(HostPropertyCollectionRef* p_pProps)
+{
+	const char* logMessagePrefix = "X265 Plugin :: MP4 :: DoOpen";
+
+	if (!p_pProps->GetString(pIOPropPath, m_Path) || m_Path.empty()) {
+		g_Log(logLevelError, "%s :: no destination path", logMessagePrefix);
+		return errInvalidParam;
+	}
+
+	LoadOptions(p_pProps);
+
+	g_Log(logLevelInfo, "%s :: path = %s", logMessagePrefix, m_Path.c_str());
+
+	return errNone;
+}
+
+StatusCode MP4Container::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPropertyCollectionRef* p_pCodecProps, IPluginTrackBase** p_pTrack)
+{
+	const char* logMessagePrefix = "X265 Plugin :: MP4 :: DoAddTrack";
+
+	uint32_t mediaType = mediaNone;
+	p_pProps->GetUINT32(pIOPropMediaType, mediaType);
+	if (mediaType != mediaVideo) {
+		g_Log(logLevelError, "%s :: only video tracks are supported, media type %u", logMessagePrefix, mediaType);
+		return errUnsupported;
+	}
+
+	if (m_Writer.IsOpen()) {
+		g_Log(logLevelError, "%s :: tracks must be added before the first sample", logMessagePrefix);
+		return errInvalidOperation;
+	}
+
+	std::unique_ptr<MP4TrackTable> pTable(new MP4TrackTable());
+
+	// the hvcC record comes with the codec properties set by the encoder at open
+	if (p_pCodecProps->IsValid()) {
+		PropertyType propType = propTypeNull;
+		const void* pVal = NULL;
+		int numVals = 0;
+		uint32_t cookieType = 'hvcC';
+		p_pCodecProps->GetUINT32(pIOPropMagicCookieType, cookieType);
+		if ((cookieType == 'hvcC') && (p_pCodecProps->GetProperty(pIOPropMagicCookie, &propType, &pVal, &numVals) == errNone) &&
+			(propType == propTypeUInt8) && (numVals > 0)) {
+			const uint8_t* pCookie = static_cast<const uint8_t*>(pVal);
+			pTable->decoderConfig.assign(pCookie, pCookie + numVals);
+		}
+
+		LoadOptions(p_pCodecProps);
+	}
+
+	if (pTable->decoderConfig.empty()) {
+		g_Log(logLevelError, "%s :: no hvcC decoder configuration, only HEVC is supported", logMessagePrefix);
+		return errUnsupported;
+	}
+
+	HostCodecConfigCommon commonProps;
+	commonProps.Load(p_pProps);
+	pTable->width = commonProps.GetWidth();
+	pTable->height = commonProps.GetHeight();
+	if (((pTable->width == 0) || (pTable->height == 0)) && p_pCodecProps->IsValid()) {
+		p_pCodecProps->GetUINT32(pIOPropWidth, pTable->width);
+		p_pCodecProps->GetUINT32(pIOPropHeight, pTable->height);
+	}
+
+	pTable->par = 1.0;
+	p_pProps->GetDouble(pIOPropPAR, pTable->par);
+	if (pTable->par <= 0) {
+		pTable->par = 1.0;
+	}
+
+	// host timestamps count time base units, or frames when only the frame rate is known
+	uint32_t num = 0;
+	uint32_t den = 0;
+	double frameRate = 0;
+	if (s_GetUINT32Pair(p_pProps, pIOPropTimeBase, num, den)) {
+		pTable->timeScale = den;
+		pTable->tickScale = num;
+	} else if (s_GetUINT32Pair(p_pProps, pIOPropFrameRate, num, den)) {
+		pTable->timeScale = num;
+		pTable->tickScale = den;
+	} else if (p_pProps->GetDouble(pIOPropFrameRate, frameRate) && (frameRate > 0)) {
+		pTable->timeScale = static_cast<uint32_t>(std::lround(frameRate * 1000));
+		pTable->tickScale = 1000;
+	} else {
+		pTable->timeScale = 25;
+		pTable->tickScale = 1;
+	}
+
+	pTable->trackID = static_cast<uint32_t>(m_Tracks.size() + 1);
+	pTable->chunkSamples = 0;
+	pTable->hasSamples = false;
+	pTable->firstDTS = 0;
+	pTable->lastDTS = 0;
+	pTable->decodeTime = 0;
+	pTable->lastDelta = pTable->tickScale;
+	pTable->minPTS = 0;
+	pTable->hasNegativeOffsets = false;
+	pTable->isFinished = false;
+	pTable->fragmentDecodeTime = 0;
+	pTable->firstPTS = 0;
+
+	g_Log(logLevelInfo, "%s :: track %u, %ux%u, time scale %u/%u, hvcC %u bytes", logMessagePrefix, pTable->trackID, pTable->width, pTable->height,
+		  pTable->timeScale, pTable->tickScale, static_cast<uint32_t>(pTable->decoderConfig.size()));
+
+	m_Tracks.push_back(std::move(pTable));
+	*p_pTrack = new MP4Track(this, static_cast<uint32_t>(m_Tracks.size() - 1));
+
+	return errNone;
+}
+
+void MP4Container::LoadOptions(IPropertyProvider* p_pProps)
+{
+	uint8_t isFastStart = 0;
+	if (p_pProps->GetUINT8(s_pFastStartKey, isFastStart)) {
+		m_IsFastStart = (isFastStart != 0);
+	}
+
+	int32_t layout = 0;
+	if (p_pProps->GetINT32(s_pLayoutKey, layout)) {
+		m_IsFragmented = (layout == 1);
+	}
+
+	int32_t fragmentDuration = 0;
+	if (p_pProps->GetINT32(s_pFragmentDurationKey, fragmentDuration) && (fragmentDuration > 0)) {
+		m_FragmentDuration = fragmentDuration;
+	}
+}
+
+StatusCode MP4Container::OpenFile()
+{
+	// a fragmented file starts with the moov already, it only describes the tracks
+	if (m_IsFragmented) {
+		m_IsFastStart = false;
+	}
+
+	// with faststart the media goes to a side file first, the final file is moov + mdat
+	m_WritePath = m_IsFastStart ? (m_Path + ".tmp") : m_Path;
+	if (!m_Writer.Open(m_WritePath)) {
+		g_Log(logLevelError, "X265 Plugin :: MP4 :: failed to create %s", m_WritePath.c_str());
+		return errFail;
+	}
+
+	std::vector<uint8_t> header;
+	s_BuildFileType(m_IsFragmented, &header);
+
+	if (m_IsFragmented) {
+		std::vector<uint8_t> movie;
+		BuildMovie(0, &movie);
+		header.insert(header.end(), movie.begin(), movie.end());
+
+		g_Log(logLevelInfo, "X265 Plugin :: MP4 :: fragmented, %.1f s fragments", m_FragmentDuration);
+
+		// the init segment is on disk before the first fragment, a packager can pick it up right away
+		return (m_Writer.Write(header.data(), header.size()) && m_Writer.Flush()) ? errNone : errFail;
+	}
+
+	m_MediaDataStart = header.size();
+
+	MP4BoxBuilder box(&header);
+	box.PutU32(1); // 64-bit size follows the type
+	box.PutU32('mdat');
+	box.PutU64(0);
+
+	return m_Writer.Write(header.data(), header.size()) ? errNone : errFail;
+}
+
+void MP4Container::StartChunk(MP4TrackTable* p_pTrack)
+{
+	s_CloseChunk(p_pTrack);
+	p_pTrack->chunkOffsets.push_back(m_Writer.GetPosition());
+}
+
+StatusCode MP4Container::WriteSample(uint32_t p_TrackIdx, HostBufferRef* p_pBuf)
+{
+	if (m_Error != errNone) {
+		return m_Error;
+	}
+
+	if ((p_TrackIdx >= m_Tracks.size()) || m_IsClosed) {
+		return errInvalidOperation;
+	}
+
+	if (!m_Writer.IsOpen()) {
+		m_Error = OpenFile();
+		if (m_Error != errNone) {
+			return m_Error;
+		}
+	}
+
+	MP4TrackTable* pTrack = m_Tracks[p_TrackIdx].get();
+
+	char* pData = NULL;
+	size_t dataSize = 0;
+	if (!p_pBuf->LockBuffer(&pData, &dataSize)) {
+		return errFail;
+	}
+
+	if (dataSize == 0) {
+		p_pBuf->UnlockBuffer();
+		return errNone;
+	}
+
+	int64_t pts = 0;
+	p_pBuf->GetINT64(pIOPropPTS, pts);
+	int64_t dts = pts;
+	p_pBuf->GetINT64(pIOPropDTS, dts);
+	uint8_t isKeyFrame = 0;
+	p_pBuf->GetUINT8(pIOPropIsKeyFrame, isKeyFrame);
+
+	// the delta of the previous sample is known once this DTS arrives, a non increasing DTS is clamped
+	// to a tick so the decode timeline stays valid
+	if (pTrack->hasSamples) {
+		int64_t delta = (dts - pTrack->lastDTS) * pTrack->tickScale;
+		if (delta <= 0) {
+			delta = 1;
+		}
+
+		if (m_IsFragmented) {
+			pTrack->fragmentSamples.back().duration = static_cast<uint32_t>(delta);
+		} else {
+			s_AppendRun(&pTrack->timeToSample, delta);
+		}
+		pTrack->decodeTime += delta;
+		pTrack->lastDelta = delta;
+	} else {
+		pTrack->hasSamples = true;
+		pTrack->firstDTS = dts;
+		pTrack->firstPTS = pts;
+		pTrack->minPTS = pts;
+	}
+
+	pTrack->lastDTS = dts;
+	pTrack->minPTS = std::min(pTrack->minPTS, pts);
+	++m_NumSamples;
+
+	if (m_IsFragmented) {
+		// a fragment ends in front of the first sync sample past the target duration, with the closed
+		// GOPs the encoder sets up for this layout that is one GOP per fragment
+		const int64_t fragmentTicks = pTrack->decodeTime - pTrack->fragmentDecodeTime;
+		const double minFragmentTicks = m_FragmentDuration * pTrack->timeScale * 0.9;
+		if ((isKeyFrame != 0) && !pTrack->fragmentSamples.empty() && (fragmentTicks >= minFragmentTicks)) {
+			m_Error = WriteFragment(pTrack);
+			if (m_Error != errNone) {
+				p_pBuf->UnlockBuffer();
+				return m_Error;
+			}
+		}
+
+		MP4FragmentSample sample;
+		sample.size = static_cast<uint32_t>(dataSize);
+		sample.duration = static_cast<uint32_t>(pTrack->lastDelta);
+		sample.flags = (isKeyFrame != 0) ? s_SyncSampleFlags : s_NonSyncSampleFlags;
+		sample.compositionOffset = static_cast<int32_t>((pts - pTrack->firstPTS) * pTrack->tickScale - pTrack->decodeTime);
+		pTrack->fragmentSamples.push_back(sample);
+		pTrack->fragmentData.insert(pTrack->fragmentData.end(), pData, pData + dataSize);
+
+		p_pBuf->UnlockBuffer();
+		return errNone;
+	}
+
+	if ((m_pLastTrack != pTrack) || (pTrack->chunkSamples >= s_MaxChunkSamples)) {
+		StartChunk(pTrack);
+	}
+	m_pLastTrack = pTrack;
+
+	const bool isWritten = m_Writer.Write(pData, dataSize);
+	p_pBuf->UnlockBuffer();
+	if (!isWritten) {
+		g_Log(logLevelError, "X265 Plugin :: MP4 :: write failed at offset %llu", static_cast<unsigned long long>(m_Writer.GetPosition()));
+		m_Error = errFail;
+		return m_Error;
+	}
+
+	const int64_t offset = (pts - pTrack->firstDTS) * pTrack->tickScale - pTrack->decodeTime;
+	s_AppendRun(&pTrack->compositionOffsets, offset);
+	pTrack->hasNegativeOffsets |= (offset < 0);
+
+	pTrack->sizes.push_back(static_cast<uint32_t>(dataSize));
+	if (isKeyFrame != 0) {
+		pTrack->syncSamples.push_back(static_cast<uint32_t>(pTrack->sizes.size()));
+	}
+	++pTrack->chunkSamples;
+
+	return errNone;
+}
+
+StatusCode MP4Container::WriteFragment(MP4TrackTable* p_pTrack)
+{
+	if (p_pTrack->fragmentSamples.empty()) {
+		return errNone;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	const size_t dataSize = p_pTrack->fragmentData.size();
+	const bool isLargeData = (dataSize + 8 > UINT32_MAX);
+	const size_t dataHeaderSize = isLargeData ? 16 : 8;
+
+	std::vector<uint8_t> header;
+	MP4BoxBuilder box(&header);
+
+	const size_t moof = box.BeginBox('moof');
+	{
+		const size_t mfhd = box.BeginFullBox('mfhd', 0, 0);
+		box.PutU32(++m_FragmentSequence);
+		box.EndBox(mfhd);
+	}
+
+	const size_t traf = box.BeginBox('traf');
+	{
+		const size_t tfhd = box.BeginFullBox('tfhd', 0, 0x020000); // default-base-is-moof
+		box.PutU32(p_pTrack->trackID);
+		box.EndBox(tfhd);
+
+		const size_t tfdt = box.BeginFullBox('tfdt', 1, 0);
+		box.PutU64(static_cast<uint64_t>(p_pTrack->fragmentDecodeTime));
+		box.EndBox(tfdt);
+
+		// data offset, duration, size, flags and composition offset per sample
+		const size_t trun = box.BeginFullBox('trun', 1, 0x000f01);
+		box.PutU32(static_cast<uint32_t>(p_pTrack->fragmentSamples.size()));
+		const size_t dataOffsetPos = header.size();
+		box.PutU32(0);
+
+		int64_t fragmentTicks = 0;
+		for (const MP4FragmentSample& sample : p_pTrack->fragmentSamples) {
+			box.PutU32(sample.duration);
+			box.PutU32(sample.size);
+			box.PutU32(sample.flags);
+			box.PutU32(static_cast<uint32_t>(sample.compositionOffset));
+			fragmentTicks += sample.duration;
+		}
+		box.EndBox(trun);
+		box.EndBox(traf);
+		box.EndBox(moof);
+
+		const uint32_t dataOffset = static_cast<uint32_t>(header.size() + dataHeaderSize);
+		header[dataOffsetPos] = static_cast<uint8_t>(dataOffset >> 24);
+		header[dataOffsetPos + 1] = static_cast<uint8_t>(dataOffset >> 16);
+		header[dataOffsetPos + 2] = static_cast<uint8_t>(dataOffset >> 8);
+		header[dataOffsetPos + 3] = static_cast<uint8_t>(dataOffset);
+
+		p_pTrack->fragmentDecodeTime += fragmentTicks;
+	}
+
+	if (isLargeData) {
+		box.PutU32(1);
+		box.PutU32('mdat');
+		box.PutU64(dataSize + dataHeaderSize);
+	} else {
+		box.PutU32(static_cast<uint32_t>(dataSize + dataHeaderSize));
+		box.PutU32('mdat');
+	}
+
+	// flushed per fragment so the file on disk always ends on a complete fragment
+	const bool isOk = m_Writer.Write(header.data(), header.size()) && m_Writer.Write(p_pTrack->fragmentData.data(), dataSize) && m_Writer.Flush();
+
+	m_MaxFragmentBytes = std::max(m_MaxFragmentBytes, dataSize);
+	m_FragmentSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	// cleared vectors keep their capacity, memory stays at the largest fragment
+	p_pTrack->fragmentSamples.clear();
+	p_pTrack->fragmentData.clear();
+
+	if (!isOk) {
+		g_Log(logLevelError, "X265 Plugin :: MP4 :: fragment %u write failed", m_FragmentSequence);
+		return errFail;
+	}
+
+	return errNone;
+}
+
+StatusCode MP4Container::FinishTrack(uint32_t p_TrackIdx)
+{
+	if (p_TrackIdx >= m_Tracks.size()) {
+		return errInvalidOperation;
+	}
+
+	MP4TrackTable* pTrack = m_Tracks[p_TrackIdx].get();
+	pTrack->isFinished = true;
+
+	// the last fragment doesn't have to wait for the container close
+	if (m_IsFragmented && m_Writer.IsOpen() && (m_Error == errNone)) {
+		m_Error = WriteFragment(pTrack);
+	}
+
+	return m_Error;
+}
+
+void MP4Container::BuildMovie(uint64_t p_OffsetShift, std::vector<uint8_t>* p_pMovie) const
+{
+	p_pMovie->clear();
+
+	const uint32_t movieTimeScale = m_Tracks.empty() ? 1000 : m_Tracks[0]->timeScale;
+	uint64_t movieDuration = 0;
+	for (const std::unique_ptr<MP4TrackTable>& pTrack : m_Tracks) {
+		movieDuration = std::max(movieDuration, s_Rescale(s_GetMediaDuration(*pTrack), pTrack->timeScale, movieTimeScale));
+	}
+
+	MP4BoxBuilder box(p_pMovie);
+	const size_t moov = box.BeginBox('moov');
+
+	{
+		const size_t mvhd = box.BeginFullBox('mvhd', 1, 0);
+		box.PutU64(0);
+		box.PutU64(0);
+		box.PutU32(movieTimeScale);
+		box.PutU64(movieDuration);
+		box.PutU32(0x00010000);
+		box.PutU16(0x0100);
+		box.PutZeros(10);
+		box.PutMatrix();
+		box.PutZeros(24);
+		box.PutU32(static_cast<uint32_t>(m_Tracks.size() + 1));
+		box.EndBox(mvhd);
+	}
+
+	for (const std::unique_ptr<MP4TrackTable>& pTrack : m_Tracks) {
+		const MP4TrackTable& track = *pTrack;
+		const uint64_t mediaDuration = s_GetMediaDuration(track);
+		const uint64_t trackDuration = s_Rescale(mediaDuration, track.timeScale, movieTimeScale);
+
+		const size_t trak = box.BeginBox('trak');
+
+		{
+			const size_t tkhd = box.BeginFullBox('tkhd', 1, 0x3);
+			box.PutU64(0);
+			box.PutU64(0);
+			box.PutU32(track.trackID);
+			box.PutU32(0);
+			box.PutU64(trackDuration);
+			box.PutZeros(16); // reserved, layer, alternate group, volume, reserved
+			box.PutMatrix();
+			box.PutU32(static_cast<uint32_t>(std::lround(track.width * track.par * 65536.0)));
+			box.PutU32(track.height << 16);
+			box.EndBox(tkhd);
+		}
+
+		// B-frames delay the first presentation, the edit list starts playback at the first displayed frame
+		const int64_t mediaStart = (track.minPTS - track.firstDTS) * track.tickScale;
+		if (track.hasSamples && (mediaStart != 0)) {
+			const size_t edts = box.BeginBox('edts');
+			const size_t elst = box.BeginFullBox('elst', 1, 0);
+			box.PutU32(1);
+			box.PutU64(trackDuration);
+			box.PutU64(static_cast<uint64_t>(mediaStart));
+			box.PutU16(1);
+			box.PutU16(0);
+			box.EndBox(elst);
+			box.EndBox(edts);
+		}
+
+		const size_t mdia = box.BeginBox('mdia');
+
+		{
+			const size_t mdhd = box.BeginFullBox('mdhd', 1, 0);
+			box.PutU64(0);
+			box.PutU64(0);
+			box.PutU32(track.timeScale);
+			box.PutU64(mediaDuration);
+			box.PutU16(0x55c4); // "und"
+			box.PutU16(0);
+			box.EndBox(mdhd);
+		}
+
+		{
+			static const char pHandlerName[] = "VideoHandler";
+			const size_t hdlr = box.BeginFullBox('hdlr', 0, 0);
+			box.PutU32(0);
+			box.PutU32('vide');
+			box.PutZeros(12);
+			box.PutBytes(reinterpret_cast<const uint8_t*>(pHandlerName), sizeof(pHandlerName));
+			box.EndBox(hdlr);
+		}
+
+		const size_t minf = box.BeginBox('minf');
+
+		{
+			const size_t vmhd = box.BeginFullBox('vmhd', 0, 1);
+			box.PutZeros(8);
+			box.EndBox(vmhd);
+
+			const size_t dinf = box.BeginBox('dinf');
+			const size_t dref = box.BeginFullBox('dref', 0, 0);
+			box.PutU32(1);
+			const size_t url = box.BeginFullBox('url ', 0, 1); // media in this file
+			box.EndBox(url);
+			box.EndBox(dref);
+			box.EndBox(dinf);
+		}
+
+		s_BuildSampleTable(track, p_OffsetShift, &box);
+
+		box.EndBox(minf);
+		box.EndBox(mdia);
+		box.EndBox(trak);
+	}
+
+	// fragmented files describe their samples in the moofs, the trex defaults are all overridden per sample
+	if (m_IsFragmented) {
+		const size_t mvex = box.BeginBox('mvex');
+		for (const std::unique_ptr<MP4TrackTable>& pTrack : m_Tracks) {
+			const size_t trex = box.BeginFullBox('trex', 0, 0);
+			box.PutU32(pTrack->trackID);
+			box.PutU32(1);
+			box.PutZeros(12);
+			box.EndBox(trex);
+		}
+		box.EndBox(mvex);
+	}
+
+	box.EndBox(moov);
+}
+
+StatusCode MP4Container::WriteFastStart()
+{
+	const char* logMessagePrefix = "X265 Plugin :: MP4 :: WriteFastStart";
+
+	if (!m_Writer.Close()) {
+		g_Log(logLevelError, "%s :: failed to finish %s", logMessagePrefix, m_WritePath.c_str());
+		return errFail;
+	}
+
+	const uint64_t numWrites = m_Writer.GetNumWrites();
+	const double writeSeconds = m_Writer.GetWriteSeconds();
+
+	// the moov size doesn't depend on the offsets it holds, so the shifted chunk offsets are known
+	// before anything is written and the mdat moves with a single streaming copy
+	std::vector<uint8_t> header;
+	s_BuildFileType(false, &header);
+
+	std::vector<uint8_t> movie;
+	BuildMovie(0, &movie);
+	BuildMovie(movie.size(), &movie);
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	BufferedFileWriter finalWriter;
+	bool isOk = finalWriter.Open(m_Path);
+	isOk = isOk && finalWriter.Write(header.data(), header.size());
+	isOk = isOk && finalWriter.Write(movie.data(), movie.size());
+	isOk = isOk && finalWriter.CopyFrom(m_WritePath, m_MediaDataStart);
+	const uint64_t fileSize = finalWriter.GetPosition();
+	isOk = finalWriter.Close() && isOk;
+
+	const double copySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	if (!isOk) {
+		g_Log(logLevelError, "%s :: failed to relocate the moov into %s, the media is kept in %s", logMessagePrefix, m_Path.c_str(), m_WritePath.c_str());
+		return errFail;
+	}
+
+	std::error_code errCode;
+	std::filesystem::remove(m_WritePath, errCode);
+
+	g_Log(logLevelInfo, "%s :: moov %u bytes, %.1f MB copied in %.2f s, media pass %llu writes in %.2f s", logMessagePrefix,
+		  static_cast<uint32_t>(movie.size()), fileSize / 1.0e6, copySeconds, static_cast<unsigned long long>(numWrites), writeSeconds);
+
+	return errNone;
+}
+
+StatusCode MP4Container::DoClose()
+{
+	const char* logMessagePrefix = "X265 Plugin :: MP4 :: DoClose";
+
+	if (m_IsClosed) {
+		return m_Error;
+	}
+
+	if (!m_Writer.IsOpen() && (m_Error == errNone)) {
+		m_Error = OpenFile();
+	}
+
+	if (m_Error != errNone) {
+		Cleanup();
+		m_IsClosed = true;
+		return m_Error;
+	}
+
+	if (m_IsFragmented) {
+		for (std::unique_ptr<MP4TrackTable>& pTrack : m_Tracks) {
+			if (m_Error == errNone) {
+				m_Error = WriteFragment(pTrack.get());
+			}
+		}
+
+		if (!m_Writer.Close() && (m_Error == errNone)) {
+			m_Error = errFail;
+		}
+
+		m_IsClosed = true;
+
+		g_Log(logLevelInfo, "%s :: %llu samples in %u fragments, largest fragment %.1f MB, %.1f MB in %llu writes, %.2f s writing fragments", logMessagePrefix,
+			  static_cast<unsigned long long>(m_NumSamples), m_FragmentSequence, m_MaxFragmentBytes / 1.0e6, m_Writer.GetPosition() / 1.0e6,
+			  static_cast<unsigned long long>(m_Writer.GetNumWrites()), m_FragmentSeconds);
+
+		return m_Error;
+	}
+
+	for (std::unique_ptr<MP4TrackTable>& pTrack : m_Tracks) {
+		s_CloseChunk(pTrack.get());
+		if (pTrack->hasSamples) {
+			s_AppendRun(&pTrack->timeToSample, pTrack->lastDelta);
+		}
+	}
+
+	const uint64_t mediaDataSize = m_Writer.GetPosition() - m_MediaDataStart;
+	uint8_t largeSize[8];
+	for (int i = 0; i < 8; ++i) {
+		largeSize[i] = static_cast<uint8_t>(mediaDataSize >> (56 - i * 8));
+	}
+
+	if (!m_Writer.WriteAt(m_MediaDataStart + 8, largeSize, sizeof(largeSize))) {
+		g_Log(logLevelError, "%s :: failed to finalize the mdat size", logMessagePrefix);
+		m_Error = errFail;
+	} else if (m_IsFastStart) {
+		m_Error = WriteFastStart();
+	} else {
+		std::vector<uint8_t> movie;
+		BuildMovie(0, &movie);
+		if (!m_Writer.Write(movie.data(), movie.size()) || !m_Writer.Close()) {
+			g_Log(logLevelError, "%s :: failed to write the moov", logMessagePrefix);
+			m_Error = errFail;
+		} else {
+			const double writeSeconds = m_Writer.GetWriteSeconds();
+			g_Log(logLevelInfo, "%s :: moov %u bytes, %.1f MB in %llu writes, %.1f MB/s", logMessagePrefix, static_cast<uint32_t>(movie.size()),
+				  m_Writer.GetPosition() / 1.0e6, static_cast<unsigned long long>(m_Writer.GetNumWrites()),
+				  (writeSeconds > 0) ? (m_Writer.GetPosition() / 1.0e6 / writeSeconds) : 0.0);
+		}
+	}
+
+	m_Writer.Close();
+	m_IsClosed = true;
+
+	g_Log(logLevelInfo, "%s :: %llu samples in %u tracks", logMessagePrefix, static_cast<unsigned long long>(m_NumSamples), static_cast<uint32_t>(m_Tracks.size()));
+
+	return m_Error;
+}
+
+MP4Track::MP4Track(MP4Container* p_pContainer, uint32_t p_TrackIdx)
+	: IPluginTrackBase(p_pContainer)
+	, m_pMP4Container(p_pContainer)
+	, m_TrackIdx(p_TrackIdx)
+{
+}
+
+MP4Track::~MP4Track()
+{
+}
+
+StatusCode MP4Track::DoWrite(HostBufferRef* p_pBuf)
+{
+	// a NULL buffer marks the end of the track
+	if (p_pBuf == NULL) {
+		return m_pMP4Container->FinishTrack(m_TrackIdx);
+	}
+
+	return m_pMP4Container->WriteSample(m_TrackIdx, p_pBuf);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wrapper/plugin_api.h"
+
+#include "file_writer.h"
+
+using namespace IOPlugin;
+
+// run of consecutive samples sharing one value (stts delta, ctts offset)
+struct MP4SampleRun
+{
+	uint32_t count;
+	int64_t value;
+};
+
+// run of consecutive chunks holding the same number of samples (stsc)
+struct MP4ChunkRun
+{
+	uint32_t firstChunk; // 1-based
+	uint32_t samplesPerChunk;
+};
+
+// sample of the open fragment, described in the trun once the fragment is complete
+struct MP4FragmentSample
+{
+	uint32_t size;
+	uint32_t duration;
+	uint32_t flags;
+	int32_t compositionOffset;
+};
+
+// sample table of one track, extended per sample so closing the file only serializes it
+struct MP4TrackTable
+{
+	uint32_t trackID;
+	uint32_t width;
+	uint32_t height;
+	double par;
+	uint32_t timeScale; // media ticks per second
+	uint32_t tickScale; // media ticks per host timestamp unit
+	std::vector<uint8_t> decoderConfig; // hvcC payload
+
+	std::vector<uint32_t> sizes;
+	std::vector<MP4SampleRun> timeToSample;
+	std::vector<MP4SampleRun> compositionOffsets;
+	std::vector<uint32_t> syncSamples; // 1-based sample numbers
+	std::vector<uint64_t> chunkOffsets;
+	std::vector<MP4ChunkRun> chunkRuns;
+	uint32_t chunkSamples; // samples in the open chunk
+
+	bool hasSamples;
+	int64_t firstDTS;
+	int64_t lastDTS;
+	int64_t decodeTime; // media ticks of the last sample, clamped deltas keep it monotonic
+	int64_t lastDelta; // media ticks
+	int64_t minPTS;
+	bool hasNegativeOffsets;
+	bool isFinished;
+
+	// fragmented layout, only the open fragment is kept and the tables above stay empty
+	std::vector<MP4FragmentSample> fragmentSamples;
+	std::vector<uint8_t> fragmentData;
+	int64_t fragmentDecodeTime; // tfdt of the open fragment
+	int64_t firstPTS; // composition times count from the first sample, a closed GOP starts with its earliest picture
+};
+
+class MP4Container : public IPluginContainerRef
+{
+public:
+	static const uint8_t s_UUID[];
+
+public:
+	MP4Container();
+
+	static StatusCode s_Register(HostListRef* p_pList);
+	// the container as listed in a codec's pIOPropContainerList
+	static std::string s_GetUUIDString();
+	static bool s_IsSelected(const std::string& p_Container);
+
+	StatusCode WriteSample(uint32_t p_TrackIdx, HostBufferRef* p_pBuf);
+	StatusCode FinishTrack(uint32_t p_TrackIdx);
+
+protected:
+	~MP4Container();
+
+	virtual StatusCode DoInit(HostPropertyCollectionRef* p_pProps) override;
+	virtual StatusCode DoOpen(HostPropertyCollectionRef* p_pProps) override;
+	virtual StatusCode DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPropertyCollectionRef* p_pCodecProps, IPluginTrackBase** p_pTrack) override;
+	virtual StatusCode DoClose() override;
+
+private:
+	void LoadOptions(IPropertyProvider* p_pProps);
+	StatusCode OpenFile();
+	void StartChunk(MP4TrackTable* p_pTrack);
+	StatusCode WriteFragment(MP4TrackTable* p_pTrack);
+	void BuildMovie(uint64_t p_OffsetShift, std::vector<uint8_t>* p_pMovie) const;
+	StatusCode WriteFastStart();
+	void Cleanup();
+
+private:
+	BufferedFileWriter m_Writer;
+	std::string m_Path;
+	std::string m_WritePath; // temporary file when the moov is relocated at close
+	std::vector<std::unique_ptr<MP4TrackTable>> m_Tracks;
+	MP4TrackTable* m_pLastTrack;
+	uint64_t m_MediaDataStart; // offset of the mdat box header
+	bool m_IsFastStart;
+	bool m_IsFragmented;
+	double m_FragmentDuration; // seconds, a fragment is closed at the first sync sample past it
+	uint32_t m_FragmentSequence;
+	size_t m_MaxFragmentBytes; // the largest fragment held in memory
+	double m_FragmentSeconds; // time spent writing fragments, the part a packager waits on
+	bool m_IsClosed;
+	uint64_t m_NumSamples;
+	StatusCode m_Error;
+};
+
+class MP4Track : public IPluginTrackBase, public IPluginTrackWriter
+{
+public:
+	MP4Track(MP4Container* p_pContainer, uint32_t p_TrackIdx);
+
+	virtual StatusCode DoWrite(HostBufferRef* p_pBuf) override;
+
+protected:
+	~MP4Track();
+
+private:
+	MP4Container* m_pMP4Container;
+	uint32_t m_TrackIdx;
+};
@@ -0,0 +1,115 @@
+#include "output_pool.h"
+
+using namespace IOPlugin;
+
+// the host API has no reference count query, a retain / release pair reports the count
+static int s_GetRefCount(const HostBufferRef* p_pBuf)
+{
+	if (!p_pBuf->IsValid()) {
+		return 0;
+	}
+
+	int newRef = 0;
+	if ((GetHostAPI()->pHandleMessage(msgRetain, p_pBuf->GetOpaque(), &newRef) != errNone) ||
+		(GetHostAPI()->pHandleMessage(msgRelease, p_pBuf->GetOpaque(), &newRef) != errNone)) {
+		return 0;
+	}
+
+	return newRef;
+}
+
+HostBufferPool::HostBufferPool()
+	: m_Next(0)
+	, m_NumAllocs(0)
+	, m_NumReuses(0)
+	, m_NumUnpooled(0)
+	, m_NumHostCalls(0)
+{
+}
+
+HostBufferPool::~HostBufferPool()
+{
+	Release();
+}
+
+HostBufferPool::Buffer* HostBufferPool::Prepare(Buffer* p_pBuffer, size_t p_Size)
+{
+	if (p_pBuffer->size != p_Size) {
+		++m_NumHostCalls;
+		if (!p_pBuffer->pBuf->Resize(p_Size)) {
+			return NULL;
+		}
+	}
+
+	p_pBuffer->size = p_Size;
+	return p_pBuffer;
+}
+
+std::unique_ptr<HostBufferPool::Buffer> HostBufferPool::Create()
+{
+	std::unique_ptr<Buffer> pBuffer(new Buffer());
+	pBuffer->pBuf.reset(new HostBufferRef(false));
+	pBuffer->size = 0;
+	pBuffer->isQueued = false;
+	pBuffer->hasProps = false;
+	pBuffer->pts = 0;
+	pBuffer->dts = 0;
+	pBuffer->isKeyFrame = 0;
+
+	++m_NumHostCalls;
+	if (!pBuffer->pBuf->IsValid()) {
+		return std::unique_ptr<Buffer>();
+	}
+
+	++m_NumAllocs;
+	return pBuffer;
+}
+
+HostBufferPool::Buffer* HostBufferPool::Acquire(size_t p_Size)
+{
+	// the host keeps its own reference to a delivered unpooled buffer, the pool lets go of it
+	std::vector<std::unique_ptr<Buffer>>::iterator it = m_Unpooled.begin();
+	while (it != m_Unpooled.end()) {
+		it = (*it)->isQueued ? (it + 1) : m_Unpooled.erase(it);
+	}
+
+	// the pool holds one reference, anything above that is the host still reading or queueing the buffer
+	const uint32_t numBuffers = static_cast<uint32_t>(m_Buffers.size());
+	for (uint32_t i = 0; i < numBuffers; ++i) {
+		const uint32_t idx = (m_Next + i) % numBuffers;
+		Buffer* pBuffer = m_Buffers[idx].get();
+		if (pBuffer->isQueued) {
+			continue;
+		}
+
+		m_NumHostCalls += 2;
+		if (s_GetRefCount(pBuffer->pBuf.get()) == 1) {
+			m_Next = (idx + 1) % numBuffers;
+			++m_NumReuses;
+			return Prepare(pBuffer, p_Size);
+		}
+	}
+
+	std::unique_ptr<Buffer> pBuffer = Create();
+	if (!pBuffer) {
+		return NULL;
+	}
+
+	if (numBuffers >= s_MaxBuffers) {
+		++m_NumUnpooled;
+		m_Unpooled.push_back(std::move(pBuffer));
+		return Prepare(m_Unpooled.back().get(), p_Size);
+	}
+
+	m_Buffers.push_back(std::move(pBuffer));
+	m_Next = 0;
+
+	return Prepare(m_Buffers.back().get(), p_Size);
+}
+
+void HostBufferPool::Release()
+{
+	m_Buffers.clear();
+	m_Unpooled.clear();
+	m_Next = 0;
+}
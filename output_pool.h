@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "wrapper/plugin_api.h"
+
+// Ring of host output buffers reused across access units. A buffer is only handed out again once
+// the host dropped its references to it and it is not waiting in the plugin's delivery queue,
+// otherwise the ring grows by one buffer. A full ring hands out unpooled buffers instead, each
+// reuse check costs host calls and a host holding on to buffers must not make every packet slower.
+class HostBufferPool
+{
+public:
+	static const uint32_t s_MaxBuffers = 16;
+
+public:
+	struct Buffer
+	{
+		std::unique_ptr<IOPlugin::HostBufferRef> pBuf;
+		size_t size;
+		bool isQueued;
+
+		// packet properties last set on the host buffer, unchanged ones are not sent again
+		bool hasProps;
+		int64_t pts;
+		int64_t dts;
+		uint8_t isKeyFrame;
+	};
+
+public:
+	HostBufferPool();
+	~HostBufferPool();
+
+	// buffer resized to p_Size bytes, NULL if the host failed to allocate
+	Buffer* Acquire(size_t p_Size);
+	void Release();
+
+	// host buffers created so far, stays constant on the steady-state path
+	uint64_t GetNumAllocs() const
+	{
+		return m_NumAllocs;
+	}
+
+	uint64_t GetNumReuses() const
+	{
+		return m_NumReuses;
+	}
+
+	// buffers handed out past the cap of the ring
+	uint64_t GetNumUnpooled() const
+	{
+		return m_NumUnpooled;
+	}
+
+	// host API messages sent by Acquire (reference count queries, creation, resizing)
+	uint64_t GetNumHostCalls() const
+	{
+		return m_NumHostCalls;
+	}
+
+private:
+	HostBufferPool(const HostBufferPool& p_Other);
+	HostBufferPool& operator=(const HostBufferPool& p_Other);
+
+	Buffer* Prepare(Buffer* p_pBuffer, size_t p_Size);
+	std::unique_ptr<Buffer> Create();
+
+private:
+	std::vector<std::unique_ptr<Buffer>> m_Buffers;
+	std::vector<std::unique_ptr<Buffer>> m_Unpooled; // dropped once they left the delivery queue
+	uint32_t m_Next;
+	uint64_t m_NumAllocs;
+	uint64_t m_NumReuses;
+	uint64_t m_NumUnpooled;
+	uint64_t m_NumHostCalls;
+};
@@ -0,0 +1,116 @@
+// Single core throughput of the NV12 / P010 chroma split and the RGBA > 4:2:0 conversion, run with
+// --scalar for the C paths.
+// Built and run by "make bench", it needs neither x265 nor the plugin SDK.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "pixel_convert.h"
+
+// one 2160p frame per iteration, chroma is half the width and height of the luma
+static const uint32_t s_Width = 3840;
+static const uint32_t s_Height = 2160;
+static const uint32_t s_NumFrames = 50;
+
+struct BenchResult
+{
+	double msPerFrame;
+	double bytesPerCycle;
+};
+
+template <typename Func>
+static BenchResult s_Run(size_t p_FrameBytes, Func p_Func)
+{
+	// the first frame warms the caches and the page tables
+	p_Func();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	const uint64_t startCycles = g_ReadCycleCounter();
+	for (uint32_t frame = 0; frame < s_NumFrames; ++frame) {
+		p_Func();
+	}
+	const uint64_t numCycles = g_ReadCycleCounter() - startCycles;
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	BenchResult result;
+	result.msPerFrame = (seconds * 1000.0) / s_NumFrames;
+	result.bytesPerCycle = (numCycles > 0) ? (static_cast<double>(p_FrameBytes) * s_NumFrames / numCycles) : 0.0;
+	return result;
+}
+
+static void s_Print(const char* p_pName, const BenchResult& p_Result)
+{
+	printf("%-28s %8.3f ms/frame %8.2f bytes/cycle\n", p_pName, p_Result.msPerFrame, p_Result.bytesPerCycle);
+}
+
+int main(int argc, char** argv)
+{
+	if ((argc > 1) && (strcmp(argv[1], "--scalar") == 0)) {
+		g_DisableSIMD();
+	}
+
+	printf("pixel_bench :: %ux%u, %u frames, simd = %s\n", s_Width, s_Height, s_NumFrames, g_GetSIMDLevelName(g_GetSIMDLevel()));
+
+	const uint32_t chromaWidth = s_Width / 2;
+	const uint32_t chromaHeight = s_Height / 2;
+	const size_t numPairs = static_cast<size_t>(chromaWidth) * chromaHeight;
+
+	// rows are contiguous, the split is timed per row the way the encoder calls it
+	std::vector<uint8_t> uv8(numPairs * 2);
+	std::vector<uint8_t> u8(numPairs);
+	std::vector<uint8_t> v8(numPairs);
+	for (size_t i = 0; i < uv8.size(); ++i) {
+		uv8[i] = static_cast<uint8_t>(i * 7);
+	}
+
+	const BenchResult split8 = s_Run(uv8.size(), [&]() {
+		for (uint32_t row = 0; row < chromaHeight; ++row) {
+			const size_t offset = static_cast<size_t>(row) * chromaWidth;
+			g_DeinterleaveUV8(uv8.data() + offset * 2, u8.data() + offset, v8.data() + offset, chromaWidth);
+		}
+	});
+	s_Print("NV12 chroma split, 8-bit", split8);
+
+	std::vector<uint16_t> uv16(numPairs * 2);
+	std::vector<uint16_t> u16(numPairs);
+	std::vector<uint16_t> v16(numPairs);
+	for (size_t i = 0; i < uv16.size(); ++i) {
+		uv16[i] = static_cast<uint16_t>((i * 7) << 6);
+	}
+
+	const BenchResult split16 = s_Run(uv16.size() * sizeof(uint16_t), [&]() {
+		for (uint32_t row = 0; row < chromaHeight; ++row) {
+			const size_t offset = static_cast<size_t>(row) * chromaWidth;
+			g_DeinterleaveUV16(uv16.data() + offset * 2, u16.data() + offset, v16.data() + offset, chromaWidth);
+		}
+	});
+	s_Print("P010 chroma split, 16-bit", split16);
+
+	// full range 8-bit RGBA to BT.709 4:2:0, two luma rows share one chroma row
+	RGBConversion conv;
+	g_InitRGBConversion(rgbMatrixBT709, 4, 8, true, &conv);
+
+	std::vector<uint8_t> rgba(static_cast<size_t>(s_Width) * s_Height * 4);
+	std::vector<uint8_t> y8(static_cast<size_t>(s_Width) * s_Height);
+	for (size_t i = 0; i < rgba.size(); ++i) {
+		rgba[i] = static_cast<uint8_t>(i * 13);
+	}
+
+	const BenchResult rgb8 = s_Run(rgba.size(), [&]() {
+		const size_t rgbaStride = static_cast<size_t>(s_Width) * 4;
+		for (uint32_t row = 0; row < chromaHeight; ++row) {
+			const uint8_t* pSrc0 = rgba.data() + 2 * static_cast<size_t>(row) * rgbaStride;
+			uint8_t* pY0 = y8.data() + 2 * static_cast<size_t>(row) * s_Width;
+			const size_t offset = static_cast<size_t>(row) * chromaWidth;
+			g_ConvertRGB(conv, pSrc0, pSrc0 + rgbaStride, pY0, pY0 + s_Width, u8.data() + offset, v8.data() + offset, s_Width, 2);
+		}
+	});
+	s_Print("RGBA > 4:2:0, 8-bit", rgb8);
+
+	return 0;
+}
@@ -0,0 +1,1075 @@
+#include "pixel_convert.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIXEL_CONVERT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC allows intrinsics for any instruction set, gcc / clang need them enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+typedef void (*DeinterleaveUV8Func)(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs);
+typedef void (*DeinterleaveUV16Func)(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs);
+typedef void (*UnpackUYVYFunc)(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width);
+typedef void (*ConvertRGBFunc)(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width, uint32_t p_HSubsampling);
+typedef void (*Downscale2x2_8Func)(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width);
+typedef void (*DownscaleUV8_2x2Func)(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width);
+typedef void (*UnpackV210Func)(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width);
+
+static void s_DeinterleaveUV8_C(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	for (size_t i = 0; i < p_NumPairs; ++i) {
+		p_pDstU[i] = p_pSrc[2 * i];
+		p_pDstV[i] = p_pSrc[2 * i + 1];
+	}
+}
+
+static void s_DeinterleaveUV16_C(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	for (size_t i = 0; i < p_NumPairs; ++i) {
+		p_pDstU[i] = p_pSrc[2 * i];
+		p_pDstV[i] = p_pSrc[2 * i + 1];
+	}
+}
+
+static void s_Downscale2x2_8_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width)
+{
+	for (size_t i = 0; i < p_Width; ++i) {
+		p_pDst[i] = static_cast<uint8_t>((p_pSrc0[2 * i] + p_pSrc0[2 * i + 1] + p_pSrc1[2 * i] + p_pSrc1[2 * i + 1] + 2) >> 2);
+	}
+}
+
+static void s_DownscaleUV8_2x2_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	for (size_t i = 0; i < p_Width; ++i) {
+		p_pDstU[i] = static_cast<uint8_t>((p_pSrc0[4 * i] + p_pSrc0[4 * i + 2] + p_pSrc1[4 * i] + p_pSrc1[4 * i + 2] + 2) >> 2);
+		p_pDstV[i] = static_cast<uint8_t>((p_pSrc0[4 * i + 1] + p_pSrc0[4 * i + 3] + p_pSrc1[4 * i + 1] + p_pSrc1[4 * i + 3] + 2) >> 2);
+	}
+}
+
+// p_X is the first pixel to convert, it has to be even
+static void s_UnpackUYVY_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_X, size_t p_Width)
+{
+	for (size_t x = p_X; x < p_Width; x += 2) {
+		const uint8_t* pPix0 = p_pSrc0 + 2 * x;
+
+		p_pDstY0[x] = pPix0[1];
+		if (x + 1 < p_Width) {
+			p_pDstY0[x + 1] = pPix0[3];
+		}
+
+		if (p_pSrc1 != NULL) {
+			const uint8_t* pPix1 = p_pSrc1 + 2 * x;
+
+			p_pDstY1[x] = pPix1[1];
+			if (x + 1 < p_Width) {
+				p_pDstY1[x + 1] = pPix1[3];
+			}
+
+			p_pDstU[x / 2] = static_cast<uint8_t>((pPix0[0] + pPix1[0] + 1) >> 1);
+			p_pDstV[x / 2] = static_cast<uint8_t>((pPix0[2] + pPix1[2] + 1) >> 1);
+		} else {
+			p_pDstU[x / 2] = pPix0[0];
+			p_pDstV[x / 2] = pPix0[2];
+		}
+	}
+}
+
+static void s_UnpackUYVY_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	s_UnpackUYVY_C(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, 0, p_Width);
+}
+
+// one v210 group holds 6 pixels in four little endian words: Cb0 Y0 Cr0 | Y1 Cb1 Y2 | Cr1 Y3 Cb2 | Y4 Cr2 Y5
+static void s_DecodeV210Group(const uint8_t* p_pSrc, uint16_t p_Y[6], uint16_t p_U[3], uint16_t p_V[3])
+{
+	uint32_t words[4];
+	for (int i = 0; i < 4; ++i) {
+		words[i] = static_cast<uint32_t>(p_pSrc[4 * i]) | (static_cast<uint32_t>(p_pSrc[4 * i + 1]) << 8) |
+				   (static_cast<uint32_t>(p_pSrc[4 * i + 2]) << 16) | (static_cast<uint32_t>(p_pSrc[4 * i + 3]) << 24);
+	}
+
+	p_U[0] = words[0] & 0x3FF;
+	p_Y[0] = (words[0] >> 10) & 0x3FF;
+	p_V[0] = (words[0] >> 20) & 0x3FF;
+	p_Y[1] = words[1] & 0x3FF;
+	p_U[1] = (words[1] >> 10) & 0x3FF;
+	p_Y[2] = (words[1] >> 20) & 0x3FF;
+	p_V[1] = words[2] & 0x3FF;
+	p_Y[3] = (words[2] >> 10) & 0x3FF;
+	p_U[2] = (words[2] >> 20) & 0x3FF;
+	p_Y[4] = words[3] & 0x3FF;
+	p_V[2] = (words[3] >> 10) & 0x3FF;
+	p_Y[5] = (words[3] >> 20) & 0x3FF;
+}
+
+// p_X is the first pixel to convert, it has to start a v210 group
+static void s_UnpackV210_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_X, size_t p_Width)
+{
+	uint16_t y0[6], u0[3], v0[3];
+	uint16_t y1[6], u1[3], v1[3];
+
+	for (size_t x = p_X; x < p_Width; x += 6) {
+		const size_t numPixels = std::min<size_t>(6, p_Width - x);
+
+		s_DecodeV210Group(p_pSrc0 + (x / 6) * 16, y0, u0, v0);
+		if (p_pSrc1 != NULL) {
+			s_DecodeV210Group(p_pSrc1 + (x / 6) * 16, y1, u1, v1);
+		}
+
+		for (size_t i = 0; i < numPixels; ++i) {
+			p_pDstY0[x + i] = y0[i];
+			if (p_pSrc1 != NULL) {
+				p_pDstY1[x + i] = y1[i];
+			}
+		}
+
+		for (size_t i = 0; i < (numPixels + 1) / 2; ++i) {
+			if (p_pSrc1 != NULL) {
+				p_pDstU[x / 2 + i] = static_cast<uint16_t>((u0[i] + u1[i] + 1) >> 1);
+				p_pDstV[x / 2 + i] = static_cast<uint16_t>((v0[i] + v1[i] + 1) >> 1);
+			} else {
+				p_pDstU[x / 2 + i] = u0[i];
+				p_pDstV[x / 2 + i] = v0[i];
+			}
+		}
+	}
+}
+
+static void s_UnpackV210_C(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width)
+{
+	s_UnpackV210_C(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, 0, p_Width);
+}
+
+// coefficients carry 14 fractional bits, this keeps 16-bit samples times the summed coefficients inside int32
+static const int s_RGBCoeffShift = 14;
+
+void g_InitRGBConversion(RGBMatrix p_Matrix, uint32_t p_NumChannels, uint32_t p_BitsPerSample, bool p_IsFullRange, RGBConversion* p_pConv)
+{
+	const double kr = (p_Matrix == rgbMatrixBT2020) ? 0.2627 : 0.2126;
+	const double kb = (p_Matrix == rgbMatrixBT2020) ? 0.0593 : 0.0722;
+	const double kg = 1.0 - kr - kb;
+
+	const double maxValue = static_cast<double>((1u << p_BitsPerSample) - 1);
+	const double rangeShift = static_cast<double>(1u << (p_BitsPerSample - 8));
+	const double scaleY = p_IsFullRange ? maxValue : (219.0 * rangeShift);
+	const double scaleC = p_IsFullRange ? maxValue : (224.0 * rangeShift);
+
+	const double one = static_cast<double>(1 << s_RGBCoeffShift);
+	const double factorY = scaleY * one / maxValue;
+	const double factorC = scaleC * one / maxValue;
+
+	const double rowY[3] = { kr, kg, kb };
+	const double rowU[3] = { -kr / (2.0 * (1.0 - kb)), -kg / (2.0 * (1.0 - kb)), 0.5 };
+	const double rowV[3] = { 0.5, -kg / (2.0 * (1.0 - kr)), -kb / (2.0 * (1.0 - kr)) };
+
+	for (int i = 0; i < 3; ++i) {
+		p_pConv->coeffsY[i] = static_cast<int32_t>(std::lround(rowY[i] * factorY));
+		p_pConv->coeffsU[i] = static_cast<int32_t>(std::lround(rowU[i] * factorC));
+		p_pConv->coeffsV[i] = static_cast<int32_t>(std::lround(rowV[i] * factorC));
+	}
+
+	p_pConv->numChannels = p_NumChannels;
+	p_pConv->bytesPerSample = (p_BitsPerSample > 8) ? 2 : 1;
+	p_pConv->offsetY = p_IsFullRange ? 0 : static_cast<int32_t>(16.0 * rangeShift);
+	p_pConv->offsetC = static_cast<int32_t>(1u << (p_BitsPerSample - 1));
+	p_pConv->maxValue = static_cast<int32_t>(maxValue);
+}
+
+static inline int32_t s_ApplyRGBCoeffs(const int32_t p_Coeffs[3], int32_t p_R, int32_t p_G, int32_t p_B, int32_t p_Offset, int32_t p_MaxValue)
+{
+	const int32_t val = ((p_Coeffs[0] * p_R + p_Coeffs[1] * p_G + p_Coeffs[2] * p_B + (1 << (s_RGBCoeffShift - 1))) >> s_RGBCoeffShift) + p_Offset;
+	return std::min(std::max(val, 0), p_MaxValue);
+}
+
+static inline void s_LoadRGB(const RGBConversion& p_Conv, const uint8_t* p_pRow, size_t p_X, int32_t p_RGB[3])
+{
+	const uint8_t* pPix = p_pRow + p_X * p_Conv.numChannels * p_Conv.bytesPerSample;
+	for (int c = 0; c < 3; ++c) {
+		p_RGB[c] = (p_Conv.bytesPerSample == 1) ? pPix[c] : reinterpret_cast<const uint16_t*>(pPix)[c];
+	}
+}
+
+static inline void s_StoreSample(const RGBConversion& p_Conv, uint8_t* p_pRow, size_t p_X, int32_t p_Val)
+{
+	if (p_Conv.bytesPerSample == 1) {
+		p_pRow[p_X] = static_cast<uint8_t>(p_Val);
+	} else {
+		reinterpret_cast<uint16_t*>(p_pRow)[p_X] = static_cast<uint16_t>(p_Val);
+	}
+}
+
+// p_X is the first pixel to convert, it has to be a multiple of p_HSubsampling.
+// Chroma is computed from the rounded average of the RGB samples it covers.
+static void s_ConvertRGB_C(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_X, size_t p_Width, uint32_t p_HSubsampling)
+{
+	const uint32_t numRows = (p_pSrc1 != NULL) ? 2 : 1;
+	const uint8_t* pSrcRows[2] = { p_pSrc0, p_pSrc1 };
+	uint8_t* pDstRows[2] = { p_pDstY0, p_pDstY1 };
+
+	for (size_t x = p_X; x < p_Width; x += p_HSubsampling) {
+		int32_t sum[3] = { 0, 0, 0 };
+		const uint32_t numCols = std::min<uint32_t>(p_HSubsampling, static_cast<uint32_t>(p_Width - x));
+
+		for (uint32_t row = 0; row < numRows; ++row) {
+			for (uint32_t col = 0; col < p_HSubsampling; ++col) {
+				// an odd width repeats the last column into the chroma average
+				int32_t rgb[3];
+				s_LoadRGB(p_Conv, pSrcRows[row], x + std::min(col, numCols - 1), rgb);
+
+				if (col < numCols) {
+					s_StoreSample(p_Conv, pDstRows[row], x + col, s_ApplyRGBCoeffs(p_Conv.coeffsY, rgb[0], rgb[1], rgb[2], p_Conv.offsetY, p_Conv.maxValue));
+				}
+
+				for (int c = 0; c < 3; ++c) {
+					sum[c] += rgb[c];
+				}
+			}
+		}
+
+		const uint32_t avgShift = (numRows == 2 ? 1 : 0) + (p_HSubsampling == 2 ? 1 : 0);
+		const int32_t avgRound = (1 << avgShift) >> 1;
+		for (int c = 0; c < 3; ++c) {
+			sum[c] = (sum[c] + avgRound) >> avgShift;
+		}
+
+		s_StoreSample(p_Conv, p_pDstU, x / p_HSubsampling, s_ApplyRGBCoeffs(p_Conv.coeffsU, sum[0], sum[1], sum[2], p_Conv.offsetC, p_Conv.maxValue));
+		s_StoreSample(p_Conv, p_pDstV, x / p_HSubsampling, s_ApplyRGBCoeffs(p_Conv.coeffsV, sum[0], sum[1], sum[2], p_Conv.offsetC, p_Conv.maxValue));
+	}
+}
+
+static void s_ConvertRGB_C(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width, uint32_t p_HSubsampling)
+{
+	s_ConvertRGB_C(p_Conv, p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, 0, p_Width, p_HSubsampling);
+}
+
+#if defined(PIXEL_CONVERT_X86)
+
+static void s_CPUID(uint32_t p_Leaf, uint32_t p_SubLeaf, uint32_t p_Regs[4])
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuidex(regs, static_cast<int>(p_Leaf), static_cast<int>(p_SubLeaf));
+	for (int i = 0; i < 4; ++i) {
+		p_Regs[i] = static_cast<uint32_t>(regs[i]);
+	}
+#else
+	__cpuid_count(p_Leaf, p_SubLeaf, p_Regs[0], p_Regs[1], p_Regs[2], p_Regs[3]);
+#endif
+}
+
+static uint64_t s_XGetBV()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax = 0;
+	uint32_t edx = 0;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static SIMDLevel s_DetectSIMDLevel()
+{
+	uint32_t regs[4] = { 0 };
+	s_CPUID(0, 0, regs);
+	const uint32_t maxLeaf = regs[0];
+
+	s_CPUID(1, 0, regs);
+	if ((regs[3] & (1u << 26)) == 0) {
+		return simdNone;
+	}
+
+	// AVX state has to be enabled by the OS (OSXSAVE + XCR0), not only reported by the CPU
+	const bool hasOSXSave = (regs[2] & (1u << 27)) != 0;
+	const bool hasAVX = (regs[2] & (1u << 28)) != 0;
+	if (!hasOSXSave || !hasAVX || (maxLeaf < 7)) {
+		return simdSSE2;
+	}
+
+	const uint64_t xcr0 = s_XGetBV();
+	if ((xcr0 & 0x6) != 0x6) {
+		return simdSSE2;
+	}
+
+	s_CPUID(7, 0, regs);
+	const bool hasAVX2 = (regs[1] & (1u << 5)) != 0;
+	const bool hasAVX512F = (regs[1] & (1u << 16)) != 0;
+	const bool hasAVX512BW = (regs[1] & (1u << 30)) != 0;
+
+	if (hasAVX512F && hasAVX512BW && ((xcr0 & 0xE6) == 0xE6)) {
+		return simdAVX512;
+	}
+
+	return hasAVX2 ? simdAVX2 : simdSSE2;
+}
+
+static void s_DeinterleaveUV8_SSE2(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	const __m128i lowMask = _mm_set1_epi16(0x00FF);
+
+	size_t i = 0;
+	for (; i + 16 <= p_NumPairs; i += 16) {
+		const __m128i uv0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 2 * i));
+		const __m128i uv1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 2 * i + 16));
+
+		const __m128i u = _mm_packus_epi16(_mm_and_si128(uv0, lowMask), _mm_and_si128(uv1, lowMask));
+		const __m128i v = _mm_packus_epi16(_mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstU + i), u);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstV + i), v);
+	}
+
+	s_DeinterleaveUV8_C(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+TARGET_AVX2 static void s_DeinterleaveUV8_AVX2(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+
+	size_t i = 0;
+	for (; i + 32 <= p_NumPairs; i += 32) {
+		const __m256i uv0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc + 2 * i));
+		const __m256i uv1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc + 2 * i + 32));
+
+		// packus works per 128-bit lane, the qword permute restores the linear order
+		__m256i u = _mm256_packus_epi16(_mm256_and_si256(uv0, lowMask), _mm256_and_si256(uv1, lowMask));
+		__m256i v = _mm256_packus_epi16(_mm256_srli_epi16(uv0, 8), _mm256_srli_epi16(uv1, 8));
+		u = _mm256_permute4x64_epi64(u, 0xD8);
+		v = _mm256_permute4x64_epi64(v, 0xD8);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstU + i), u);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstV + i), v);
+	}
+
+	s_DeinterleaveUV8_SSE2(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+TARGET_AVX512 static void s_DeinterleaveUV8_AVX512(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	const __m512i lowMask = _mm512_set1_epi16(0x00FF);
+	const __m512i laneOrder = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+
+	size_t i = 0;
+	for (; i + 64 <= p_NumPairs; i += 64) {
+		const __m512i uv0 = _mm512_loadu_si512(p_pSrc + 2 * i);
+		const __m512i uv1 = _mm512_loadu_si512(p_pSrc + 2 * i + 64);
+
+		__m512i u = _mm512_packus_epi16(_mm512_and_si512(uv0, lowMask), _mm512_and_si512(uv1, lowMask));
+		__m512i v = _mm512_packus_epi16(_mm512_srli_epi16(uv0, 8), _mm512_srli_epi16(uv1, 8));
+		u = _mm512_maskz_permutexvar_epi64(0xFF, laneOrder, u);
+		v = _mm512_maskz_permutexvar_epi64(0xFF, laneOrder, v);
+
+		_mm512_storeu_si512(p_pDstU + i, u);
+		_mm512_storeu_si512(p_pDstV + i, v);
+	}
+
+	s_DeinterleaveUV8_SSE2(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+// 16-bit split: sign-extending each half of a dword keeps the bit pattern intact through the signed pack
+static void s_DeinterleaveUV16_SSE2(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	size_t i = 0;
+	for (; i + 8 <= p_NumPairs; i += 8) {
+		const __m128i uv0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 2 * i));
+		const __m128i uv1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 2 * i + 8));
+
+		const __m128i u = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(uv0, 16), 16), _mm_srai_epi32(_mm_slli_epi32(uv1, 16), 16));
+		const __m128i v = _mm_packs_epi32(_mm_srai_epi32(uv0, 16), _mm_srai_epi32(uv1, 16));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstU + i), u);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstV + i), v);
+	}
+
+	s_DeinterleaveUV16_C(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+TARGET_AVX2 static void s_DeinterleaveUV16_AVX2(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	size_t i = 0;
+	for (; i + 16 <= p_NumPairs; i += 16) {
+		const __m256i uv0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc + 2 * i));
+		const __m256i uv1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc + 2 * i + 16));
+
+		__m256i u = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(uv0, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(uv1, 16), 16));
+		__m256i v = _mm256_packs_epi32(_mm256_srai_epi32(uv0, 16), _mm256_srai_epi32(uv1, 16));
+		u = _mm256_permute4x64_epi64(u, 0xD8);
+		v = _mm256_permute4x64_epi64(v, 0xD8);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstU + i), u);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstV + i), v);
+	}
+
+	s_DeinterleaveUV16_SSE2(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+TARGET_AVX512 static void s_DeinterleaveUV16_AVX512(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	// two-source word permutes pick the even / odd samples across both registers in one step
+	const __m512i evenIdx = _mm512_set_epi16(62, 60, 58, 56, 54, 52, 50, 48, 46, 44, 42, 40, 38, 36, 34, 32,
+											 30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+	const __m512i oddIdx = _mm512_add_epi16(evenIdx, _mm512_set1_epi16(1));
+
+	size_t i = 0;
+	for (; i + 32 <= p_NumPairs; i += 32) {
+		const __m512i uv0 = _mm512_loadu_si512(p_pSrc + 2 * i);
+		const __m512i uv1 = _mm512_loadu_si512(p_pSrc + 2 * i + 32);
+
+		_mm512_storeu_si512(p_pDstU + i, _mm512_permutex2var_epi16(uv0, evenIdx, uv1));
+		_mm512_storeu_si512(p_pDstV + i, _mm512_permutex2var_epi16(uv0, oddIdx, uv1));
+	}
+
+	s_DeinterleaveUV16_SSE2(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+// 8-bit box filter: the even and odd bytes of both rows are summed as 16-bit words, 4 * 255 + 2 still fits
+static void s_Downscale2x2_8_SSE2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width)
+{
+	const __m128i lowMask = _mm_set1_epi16(0x00FF);
+	const __m128i round = _mm_set1_epi16(2);
+
+	size_t i = 0;
+	for (; i + 16 <= p_Width; i += 16) {
+		__m128i sums[2];
+		for (int half = 0; half < 2; ++half) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc0 + 2 * i + 16 * half));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc1 + 2 * i + 16 * half));
+			const __m128i even = _mm_add_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+			const __m128i odd = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+			sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(even, odd), round), 2);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i), _mm_packus_epi16(sums[0], sums[1]));
+	}
+
+	s_Downscale2x2_8_C(p_pSrc0 + 2 * i, p_pSrc1 + 2 * i, p_pDst + i, p_Width - i);
+}
+
+// the U and V bytes are split into words as in the NV12 split, the neighbour of each word sits in the same dword
+static void s_DownscaleUV8_2x2_SSE2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	const __m128i lowMask = _mm_set1_epi16(0x00FF);
+	const __m128i wordMask = _mm_set1_epi32(0x0000FFFF);
+	const __m128i round = _mm_set1_epi32(2);
+
+	size_t i = 0;
+	for (; i + 8 <= p_Width; i += 8) {
+		__m128i sumsU[2];
+		__m128i sumsV[2];
+		for (int half = 0; half < 2; ++half) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc0 + 4 * i + 16 * half));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc1 + 4 * i + 16 * half));
+			const __m128i u = _mm_add_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+			const __m128i v = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+			sumsU[half] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_and_si128(u, wordMask), _mm_srli_epi32(u, 16)), round), 2);
+			sumsV[half] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_and_si128(v, wordMask), _mm_srli_epi32(v, 16)), round), 2);
+		}
+
+		const __m128i u = _mm_packs_epi32(sumsU[0], sumsU[1]);
+		const __m128i v = _mm_packs_epi32(sumsV[0], sumsV[1]);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstU + i), _mm_packus_epi16(u, u));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstV + i), _mm_packus_epi16(v, v));
+	}
+
+	s_DownscaleUV8_2x2_C(p_pSrc0 + 4 * i, p_pSrc1 + 4 * i, p_pDstU + i, p_pDstV + i, p_Width - i);
+}
+
+TARGET_AVX2 static void s_Downscale2x2_8_AVX2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width)
+{
+	const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+	const __m256i round = _mm256_set1_epi16(2);
+
+	size_t i = 0;
+	for (; i + 32 <= p_Width; i += 32) {
+		__m256i sums[2];
+		for (int half = 0; half < 2; ++half) {
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc0 + 2 * i + 32 * half));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc1 + 2 * i + 32 * half));
+			const __m256i even = _mm256_add_epi16(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+			const __m256i odd = _mm256_add_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+			sums[half] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(even, odd), round), 2);
+		}
+
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDst + i), packed);
+	}
+
+	s_Downscale2x2_8_SSE2(p_pSrc0 + 2 * i, p_pSrc1 + 2 * i, p_pDst + i, p_Width - i);
+}
+
+// UYVY: the odd bytes are luma, the even bytes interleaved chroma which goes through the NV12 split
+static void s_UnpackUYVY_SSE2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	const __m128i lowMask = _mm_set1_epi16(0x00FF);
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t x = 0;
+	for (; x + 16 <= p_Width; x += 16) {
+		const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc0 + 2 * x));
+		const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc0 + 2 * x + 16));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstY0 + x), _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8)));
+		__m128i uv = _mm_packus_epi16(_mm_and_si128(a0, lowMask), _mm_and_si128(b0, lowMask));
+
+		if (p_pSrc1 != NULL) {
+			const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc1 + 2 * x));
+			const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc1 + 2 * x + 16));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstY1 + x), _mm_packus_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8)));
+			uv = _mm_avg_epu8(uv, _mm_packus_epi16(_mm_and_si128(a1, lowMask), _mm_and_si128(b1, lowMask)));
+		}
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstU + x / 2), _mm_packus_epi16(_mm_and_si128(uv, lowMask), zero));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstV + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+	}
+
+	s_UnpackUYVY_C(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, x, p_Width);
+}
+
+TARGET_AVX2 static void s_UnpackUYVY_AVX2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+
+	size_t x = 0;
+	for (; x + 32 <= p_Width; x += 32) {
+		const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc0 + 2 * x));
+		const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc0 + 2 * x + 32));
+
+		const __m256i y0 = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(b0, 8));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstY0 + x), _mm256_permute4x64_epi64(y0, 0xD8));
+		__m256i uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a0, lowMask), _mm256_and_si256(b0, lowMask)), 0xD8);
+
+		if (p_pSrc1 != NULL) {
+			const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc1 + 2 * x));
+			const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc1 + 2 * x + 32));
+
+			const __m256i y1 = _mm256_packus_epi16(_mm256_srli_epi16(a1, 8), _mm256_srli_epi16(b1, 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDstY1 + x), _mm256_permute4x64_epi64(y1, 0xD8));
+			uv = _mm256_avg_epu8(uv, _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a1, lowMask), _mm256_and_si256(b1, lowMask)), 0xD8));
+		}
+
+		// 16 UV pairs left, split them like NV12 chroma
+		const __m256i uvPacked = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(uv, lowMask), _mm256_srli_epi16(uv, 8)), 0xD8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstU + x / 2), _mm256_castsi256_si128(uvPacked));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstV + x / 2), _mm256_extracti128_si256(uvPacked, 1));
+	}
+
+	s_UnpackUYVY_SSE2(p_pSrc0 + 2 * x, (p_pSrc1 != NULL) ? (p_pSrc1 + 2 * x) : NULL, p_pDstY0 + x, (p_pDstY1 != NULL) ? (p_pDstY1 + x) : NULL, p_pDstU + x / 2, p_pDstV + x / 2, p_Width - x);
+}
+
+// v210: the three 10-bit fields of each word are isolated and gathered into luma and chroma with byte shuffles
+TARGET_AVX2 static inline void s_DecodeV210Group_AVX2(const uint8_t* p_pSrc, __m128i& p_Y, __m128i& p_UV)
+{
+	const __m128i fieldMask = _mm_set1_epi32(0x3FF);
+
+	const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc));
+	const __m128i a = _mm_and_si128(words, fieldMask);
+	const __m128i b = _mm_and_si128(_mm_srli_epi32(words, 10), fieldMask);
+	const __m128i c = _mm_and_si128(_mm_srli_epi32(words, 20), fieldMask);
+
+	// ab words: Cb0 Y0 Y1 Cb1 Cr1 Y3 Y4 Cr2, c words: Cr0 - Y2 - Cb2 - Y5 -
+	const __m128i ab = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+
+	const __m128i yFromAB = _mm_setr_epi8(2, 3, 4, 5, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1);
+	const __m128i yFromC = _mm_setr_epi8(-1, -1, -1, -1, 4, 5, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1);
+	p_Y = _mm_or_si128(_mm_shuffle_epi8(ab, yFromAB), _mm_shuffle_epi8(c, yFromC));
+
+	// U in words 0-2, V in words 4-6
+	const __m128i uvFromAB = _mm_setr_epi8(0, 1, 6, 7, -1, -1, -1, -1, -1, -1, 8, 9, 14, 15, -1, -1);
+	const __m128i uvFromC = _mm_setr_epi8(-1, -1, -1, -1, 8, 9, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1);
+	p_UV = _mm_or_si128(_mm_shuffle_epi8(ab, uvFromAB), _mm_shuffle_epi8(c, uvFromC));
+}
+
+TARGET_AVX2 static void s_UnpackV210_AVX2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width)
+{
+	// a group writes 8 luma and 4 chroma samples of which 6 and 3 are valid, keep the spill inside the row
+	size_t x = 0;
+	for (; x + 8 <= p_Width; x += 6) {
+		__m128i y0;
+		__m128i uv;
+		s_DecodeV210Group_AVX2(p_pSrc0 + (x / 6) * 16, y0, uv);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstY0 + x), y0);
+
+		if (p_pSrc1 != NULL) {
+			__m128i y1;
+			__m128i uv1;
+			s_DecodeV210Group_AVX2(p_pSrc1 + (x / 6) * 16, y1, uv1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDstY1 + x), y1);
+			uv = _mm_avg_epu16(uv, uv1);
+		}
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstU + x / 2), uv);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDstV + x / 2), _mm_srli_si128(uv, 8));
+	}
+
+	s_UnpackV210_C(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, x, p_Width);
+}
+
+// RGB(A): 8 pixels are widened to one int32 vector per channel, the matrix runs on 16 pixels per iteration
+TARGET_AVX2 static inline void s_LoadRGB8Pixels_AVX2(const RGBConversion& p_Conv, const uint8_t* p_pSrc, __m256i& p_R, __m256i& p_G, __m256i& p_B)
+{
+	__m256i pixels;
+
+	if (p_Conv.bytesPerSample == 1) {
+		if (p_Conv.numChannels == 4) {
+			pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc));
+		} else {
+			// 4 RGB pixels per lane spread to RGBx, the upper load reads 4 bytes past the 8 pixels
+			const __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc))),
+														_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 12)), 1);
+			const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+													0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			pixels = _mm256_shuffle_epi8(rgb, spread);
+		}
+
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		p_R = _mm256_and_si256(pixels, byteMask);
+		p_G = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask);
+		p_B = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask);
+		return;
+	}
+
+	// 16-bit: each lane is regrouped to R0R1 G0G1 B0B1 xx so two lanes hold 4 pixels
+	__m256i lo;
+	__m256i hi;
+	if (p_Conv.numChannels == 4) {
+		const __m256i group = _mm256_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, -1, -1, -1, -1,
+											   0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, -1, -1, -1, -1);
+		lo = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc)), group);
+		hi = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pSrc + 32)), group);
+	} else {
+		// 2 pixels (12 bytes) per lane, the last load reads 4 bytes past the 8 pixels
+		const __m256i group = _mm256_setr_epi8(0, 1, 6, 7, 2, 3, 8, 9, 4, 5, 10, 11, -1, -1, -1, -1,
+											   0, 1, 6, 7, 2, 3, 8, 9, 4, 5, 10, 11, -1, -1, -1, -1);
+		const __m256i rgbLo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc))),
+													  _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 12)), 1);
+		const __m256i rgbHi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 24))),
+													  _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 36)), 1);
+		lo = _mm256_shuffle_epi8(rgbLo, group);
+		hi = _mm256_shuffle_epi8(rgbHi, group);
+	}
+
+	// lane words: lo = p0p1 | p2p3, hi = p4p5 | p6p7 > R0R1 R4R5 G0G1 G4G5 | R2R3 R6R7 G2G3 G6G7
+	const __m256i rg = _mm256_unpacklo_epi32(lo, hi);
+	const __m256i bx = _mm256_unpackhi_epi32(lo, hi);
+	const __m256i zero = _mm256_setzero_si256();
+
+	p_R = _mm256_permute4x64_epi64(_mm256_unpacklo_epi16(_mm256_unpacklo_epi64(rg, zero), zero), 0xD8);
+	p_G = _mm256_permute4x64_epi64(_mm256_unpacklo_epi16(_mm256_unpackhi_epi64(rg, zero), zero), 0xD8);
+	p_B = _mm256_permute4x64_epi64(_mm256_unpacklo_epi16(_mm256_unpacklo_epi64(bx, zero), zero), 0xD8);
+}
+
+TARGET_AVX2 static inline __m256i s_ApplyRGBCoeffs_AVX2(const int32_t p_Coeffs[3], __m256i p_R, __m256i p_G, __m256i p_B, __m256i p_Offset)
+{
+	__m256i acc = _mm256_add_epi32(_mm256_mullo_epi32(p_R, _mm256_set1_epi32(p_Coeffs[0])), _mm256_mullo_epi32(p_G, _mm256_set1_epi32(p_Coeffs[1])));
+	acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(p_B, _mm256_set1_epi32(p_Coeffs[2])));
+	acc = _mm256_add_epi32(acc, _mm256_set1_epi32(1 << (s_RGBCoeffShift - 1)));
+	return _mm256_add_epi32(_mm256_srai_epi32(acc, s_RGBCoeffShift), p_Offset);
+}
+
+// stores 16 samples held as two int32 vectors, saturation matches the clamp of the C path
+TARGET_AVX2 static inline void s_StoreRGBResult16_AVX2(const RGBConversion& p_Conv, uint8_t* p_pDst, __m256i p_Lo, __m256i p_Hi)
+{
+	const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(p_Lo, p_Hi), 0xD8);
+	if (p_Conv.bytesPerSample == 1) {
+		const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst), _mm256_castsi256_si128(bytes));
+	} else {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pDst), words);
+	}
+}
+
+// stores 8 samples held in one int32 vector
+TARGET_AVX2 static inline void s_StoreRGBResult8_AVX2(const RGBConversion& p_Conv, uint8_t* p_pDst, __m256i p_Val)
+{
+	const __m128i words = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(p_Val, p_Val), 0x08));
+	if (p_Conv.bytesPerSample == 1) {
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p_pDst), _mm_packus_epi16(words, words));
+	} else {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst), words);
+	}
+}
+
+TARGET_AVX2 static void s_ConvertRGB_AVX2(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width, uint32_t p_HSubsampling)
+{
+	const size_t pixelBytes = static_cast<size_t>(p_Conv.numChannels) * p_Conv.bytesPerSample;
+	const size_t bps = p_Conv.bytesPerSample;
+	const __m256i offsetY = _mm256_set1_epi32(p_Conv.offsetY);
+	const __m256i offsetC = _mm256_set1_epi32(p_Conv.offsetC);
+
+	const int numRows = (p_pSrc1 != NULL) ? 2 : 1;
+	const uint8_t* pSrcRows[2] = { p_pSrc0, p_pSrc1 };
+	uint8_t* pDstRows[2] = { p_pDstY0, p_pDstY1 };
+
+	const int avgShift = (numRows == 2 ? 1 : 0) + (p_HSubsampling == 2 ? 1 : 0);
+	const __m256i avgRound = _mm256_set1_epi32((1 << avgShift) >> 1);
+
+	// packed RGB loads spill 4 bytes past the 16 pixels, keep them inside the row
+	const size_t margin = (p_Conv.numChannels == 3) ? 2 : 0;
+
+	size_t x = 0;
+	for (; x + 16 + margin <= p_Width; x += 16) {
+		__m256i sum[2][3];
+
+		for (int row = 0; row < numRows; ++row) {
+			__m256i rgb[2][3];
+			for (int half = 0; half < 2; ++half) {
+				s_LoadRGB8Pixels_AVX2(p_Conv, pSrcRows[row] + (x + 8 * half) * pixelBytes, rgb[half][0], rgb[half][1], rgb[half][2]);
+			}
+
+			const __m256i yLo = s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsY, rgb[0][0], rgb[0][1], rgb[0][2], offsetY);
+			const __m256i yHi = s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsY, rgb[1][0], rgb[1][1], rgb[1][2], offsetY);
+			s_StoreRGBResult16_AVX2(p_Conv, pDstRows[row] + x * bps, yLo, yHi);
+
+			for (int half = 0; half < 2; ++half) {
+				for (int c = 0; c < 3; ++c) {
+					sum[half][c] = (row == 0) ? rgb[half][c] : _mm256_add_epi32(sum[half][c], rgb[half][c]);
+				}
+			}
+		}
+
+		if (p_HSubsampling == 2) {
+			// horizontal pairs: hadd works per lane, the qword permute restores pixel order
+			__m256i pairs[3];
+			for (int c = 0; c < 3; ++c) {
+				pairs[c] = _mm256_permute4x64_epi64(_mm256_hadd_epi32(sum[0][c], sum[1][c]), 0xD8);
+				pairs[c] = _mm256_srai_epi32(_mm256_add_epi32(pairs[c], avgRound), avgShift);
+			}
+
+			s_StoreRGBResult8_AVX2(p_Conv, p_pDstU + (x / 2) * bps, s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsU, pairs[0], pairs[1], pairs[2], offsetC));
+			s_StoreRGBResult8_AVX2(p_Conv, p_pDstV + (x / 2) * bps, s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsV, pairs[0], pairs[1], pairs[2], offsetC));
+		} else {
+			for (int half = 0; half < 2; ++half) {
+				for (int c = 0; c < 3; ++c) {
+					sum[half][c] = _mm256_srai_epi32(_mm256_add_epi32(sum[half][c], avgRound), avgShift);
+				}
+			}
+
+			s_StoreRGBResult16_AVX2(p_Conv, p_pDstU + x * bps, s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsU, sum[0][0], sum[0][1], sum[0][2], offsetC),
+									s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsU, sum[1][0], sum[1][1], sum[1][2], offsetC));
+			s_StoreRGBResult16_AVX2(p_Conv, p_pDstV + x * bps, s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsV, sum[0][0], sum[0][1], sum[0][2], offsetC),
+									s_ApplyRGBCoeffs_AVX2(p_Conv.coeffsV, sum[1][0], sum[1][1], sum[1][2], offsetC));
+		}
+	}
+
+	s_ConvertRGB_C(p_Conv, p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, x, p_Width, p_HSubsampling);
+}
+
+#elif defined(PIXEL_CONVERT_NEON)
+
+static SIMDLevel s_DetectSIMDLevel()
+{
+	return simdNEON;
+}
+
+static void s_DeinterleaveUV8_NEON(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	size_t i = 0;
+	for (; i + 16 <= p_NumPairs; i += 16) {
+		const uint8x16x2_t uv = vld2q_u8(p_pSrc + 2 * i);
+		vst1q_u8(p_pDstU + i, uv.val[0]);
+		vst1q_u8(p_pDstV + i, uv.val[1]);
+	}
+
+	s_DeinterleaveUV8_C(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+static void s_DeinterleaveUV16_NEON(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	size_t i = 0;
+	for (; i + 8 <= p_NumPairs; i += 8) {
+		const uint16x8x2_t uv = vld2q_u16(p_pSrc + 2 * i);
+		vst1q_u16(p_pDstU + i, uv.val[0]);
+		vst1q_u16(p_pDstV + i, uv.val[1]);
+	}
+
+	s_DeinterleaveUV16_C(p_pSrc + 2 * i, p_pDstU + i, p_pDstV + i, p_NumPairs - i);
+}
+
+// pairwise widening adds take the horizontal pair, the rounding narrow shift divides by four
+static void s_Downscale2x2_8_NEON(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width)
+{
+	size_t i = 0;
+	for (; i + 16 <= p_Width; i += 16) {
+		const uint16x8_t sumLo = vpadalq_u8(vpaddlq_u8(vld1q_u8(p_pSrc0 + 2 * i)), vld1q_u8(p_pSrc1 + 2 * i));
+		const uint16x8_t sumHi = vpadalq_u8(vpaddlq_u8(vld1q_u8(p_pSrc0 + 2 * i + 16)), vld1q_u8(p_pSrc1 + 2 * i + 16));
+		vst1q_u8(p_pDst + i, vcombine_u8(vrshrn_n_u16(sumLo, 2), vrshrn_n_u16(sumHi, 2)));
+	}
+
+	s_Downscale2x2_8_C(p_pSrc0 + 2 * i, p_pSrc1 + 2 * i, p_pDst + i, p_Width - i);
+}
+
+static void s_DownscaleUV8_2x2_NEON(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	size_t i = 0;
+	for (; i + 8 <= p_Width; i += 8) {
+		const uint8x16x2_t uv0 = vld2q_u8(p_pSrc0 + 4 * i);
+		const uint8x16x2_t uv1 = vld2q_u8(p_pSrc1 + 4 * i);
+		vst1_u8(p_pDstU + i, vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(uv0.val[0]), uv1.val[0]), 2));
+		vst1_u8(p_pDstV + i, vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(uv0.val[1]), uv1.val[1]), 2));
+	}
+
+	s_DownscaleUV8_2x2_C(p_pSrc0 + 4 * i, p_pSrc1 + 4 * i, p_pDstU + i, p_pDstV + i, p_Width - i);
+}
+
+#else
+
+static SIMDLevel s_DetectSIMDLevel()
+{
+	return simdNone;
+}
+
+#endif
+
+static bool s_IsSIMDDisabled = false;
+
+void g_DisableSIMD()
+{
+	s_IsSIMDDisabled = true;
+}
+
+SIMDLevel g_GetSIMDLevel()
+{
+	static const SIMDLevel s_Level = s_IsSIMDDisabled ? simdNone : s_DetectSIMDLevel();
+	return s_Level;
+}
+
+const char* g_GetSIMDLevelName(SIMDLevel p_Level)
+{
+	switch (p_Level) {
+	case simdSSE2:
+		return "sse2";
+	case simdAVX2:
+		return "avx2";
+	case simdAVX512:
+		return "avx512";
+	case simdNEON:
+		return "neon";
+	default:
+		break;
+	}
+
+	return "c";
+}
+
+static DeinterleaveUV8Func s_SelectDeinterleaveUV8()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+		return s_DeinterleaveUV8_AVX512;
+	case simdAVX2:
+		return s_DeinterleaveUV8_AVX2;
+	case simdSSE2:
+		return s_DeinterleaveUV8_SSE2;
+#elif defined(PIXEL_CONVERT_NEON)
+	case simdNEON:
+		return s_DeinterleaveUV8_NEON;
+#endif
+	default:
+		break;
+	}
+
+	return s_DeinterleaveUV8_C;
+}
+
+void g_DeinterleaveUV8(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs)
+{
+	static const DeinterleaveUV8Func s_pFunc = s_SelectDeinterleaveUV8();
+	s_pFunc(p_pSrc, p_pDstU, p_pDstV, p_NumPairs);
+}
+
+static DeinterleaveUV16Func s_SelectDeinterleaveUV16()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+		return s_DeinterleaveUV16_AVX512;
+	case simdAVX2:
+		return s_DeinterleaveUV16_AVX2;
+	case simdSSE2:
+		return s_DeinterleaveUV16_SSE2;
+#elif defined(PIXEL_CONVERT_NEON)
+	case simdNEON:
+		return s_DeinterleaveUV16_NEON;
+#endif
+	default:
+		break;
+	}
+
+	return s_DeinterleaveUV16_C;
+}
+
+void g_DeinterleaveUV16(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs)
+{
+	static const DeinterleaveUV16Func s_pFunc = s_SelectDeinterleaveUV16();
+	s_pFunc(p_pSrc, p_pDstU, p_pDstV, p_NumPairs);
+}
+
+static Downscale2x2_8Func s_SelectDownscale2x2_8()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+	case simdAVX2:
+		return s_Downscale2x2_8_AVX2;
+	case simdSSE2:
+		return s_Downscale2x2_8_SSE2;
+#elif defined(PIXEL_CONVERT_NEON)
+	case simdNEON:
+		return s_Downscale2x2_8_NEON;
+#endif
+	default:
+		break;
+	}
+
+	return s_Downscale2x2_8_C;
+}
+
+void g_Downscale2x2_8(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width)
+{
+	static const Downscale2x2_8Func s_pFunc = s_SelectDownscale2x2_8();
+	s_pFunc(p_pSrc0, p_pSrc1, p_pDst, p_Width);
+}
+
+// 16-bit samples are left to the compiler, a sum of four needs 18 bits and the widening costs what it saves
+void g_Downscale2x2_16(const uint16_t* p_pSrc0, const uint16_t* p_pSrc1, uint16_t* p_pDst, size_t p_Width)
+{
+	for (size_t i = 0; i < p_Width; ++i) {
+		const uint32_t sum = static_cast<uint32_t>(p_pSrc0[2 * i]) + p_pSrc0[2 * i + 1] + p_pSrc1[2 * i] + p_pSrc1[2 * i + 1];
+		p_pDst[i] = static_cast<uint16_t>((sum + 2) >> 2);
+	}
+}
+
+static DownscaleUV8_2x2Func s_SelectDownscaleUV8_2x2()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+	case simdAVX2:
+	case simdSSE2:
+		return s_DownscaleUV8_2x2_SSE2;
+#elif defined(PIXEL_CONVERT_NEON)
+	case simdNEON:
+		return s_DownscaleUV8_2x2_NEON;
+#endif
+	default:
+		break;
+	}
+
+	return s_DownscaleUV8_2x2_C;
+}
+
+void g_DownscaleUV8_2x2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	static const DownscaleUV8_2x2Func s_pFunc = s_SelectDownscaleUV8_2x2();
+	s_pFunc(p_pSrc0, p_pSrc1, p_pDstU, p_pDstV, p_Width);
+}
+
+void g_DownscaleUV16_2x2(const uint16_t* p_pSrc0, const uint16_t* p_pSrc1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width)
+{
+	for (size_t i = 0; i < p_Width; ++i) {
+		const uint32_t sumU = static_cast<uint32_t>(p_pSrc0[4 * i]) + p_pSrc0[4 * i + 2] + p_pSrc1[4 * i] + p_pSrc1[4 * i + 2];
+		const uint32_t sumV = static_cast<uint32_t>(p_pSrc0[4 * i + 1]) + p_pSrc0[4 * i + 3] + p_pSrc1[4 * i + 1] + p_pSrc1[4 * i + 3];
+		p_pDstU[i] = static_cast<uint16_t>((sumU + 2) >> 2);
+		p_pDstV[i] = static_cast<uint16_t>((sumV + 2) >> 2);
+	}
+}
+
+static UnpackUYVYFunc s_SelectUnpackUYVY()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+	case simdAVX2:
+		return s_UnpackUYVY_AVX2;
+	case simdSSE2:
+		return s_UnpackUYVY_SSE2;
+#endif
+	default:
+		break;
+	}
+
+	return s_UnpackUYVY_C;
+}
+
+void g_UnpackUYVY(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width)
+{
+	static const UnpackUYVYFunc s_pFunc = s_SelectUnpackUYVY();
+	s_pFunc(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, p_Width);
+}
+
+static UnpackV210Func s_SelectUnpackV210()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+	case simdAVX2:
+		return s_UnpackV210_AVX2;
+#endif
+	default:
+		break;
+	}
+
+	return s_UnpackV210_C;
+}
+
+void g_UnpackV210(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width)
+{
+	static const UnpackV210Func s_pFunc = s_SelectUnpackV210();
+	s_pFunc(p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, p_Width);
+}
+
+static ConvertRGBFunc s_SelectConvertRGB()
+{
+	switch (g_GetSIMDLevel()) {
+#if defined(PIXEL_CONVERT_X86)
+	case simdAVX512:
+	case simdAVX2:
+		return s_ConvertRGB_AVX2;
+#endif
+	default:
+		break;
+	}
+
+	return s_ConvertRGB_C;
+}
+
+void g_ConvertRGB(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width, uint32_t p_HSubsampling)
+{
+	static const ConvertRGBFunc s_pFunc = s_SelectConvertRGB();
+	s_pFunc(p_Conv, p_pSrc0, p_pSrc1, p_pDstY0, p_pDstY1, p_pDstU, p_pDstV, p_Width, p_HSubsampling);
+}
+
+uint64_t g_ReadCycleCounter()
+{
+#if defined(PIXEL_CONVERT_X86)
+	return __rdtsc();
+#elif defined(PIXEL_CONVERT_NEON) && !defined(_MSC_VER)
+	// generic timer, ticks at a fixed rate rather than core cycles
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum SIMDLevel
+{
+	simdNone = 0,
+	simdSSE2,
+	simdAVX2,
+	simdAVX512,
+	simdNEON,
+};
+
+// highest instruction set supported by both the CPU and the OS, detected once per process
+SIMDLevel g_GetSIMDLevel();
+// scalar paths only, has to be called before the first conversion, pixel_bench uses it for the C baseline
+void g_DisableSIMD();
+const char* g_GetSIMDLevelName(SIMDLevel p_Level);
+
+// NV12 > I420, splits p_NumPairs interleaved UV samples into separate U and V planes
+void g_DeinterleaveUV8(const uint8_t* p_pSrc, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_NumPairs);
+
+// NV12 > I420 for 16-bit containers (P010 / P016), samples are moved untouched
+void g_DeinterleaveUV16(const uint16_t* p_pSrc, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_NumPairs);
+
+// UYVY 4:2:2 > planar, with p_pSrc1 set the chroma of the two rows is averaged into one 4:2:0 chroma row
+void g_UnpackUYVY(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width);
+
+// v210 4:2:2 > planar 10-bit, with p_pSrc1 set the chroma of the two rows is averaged into one 4:2:0 chroma row
+void g_UnpackV210(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint16_t* p_pDstY0, uint16_t* p_pDstY1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width);
+
+// bytes per v210 line, lines are padded to 48 pixel / 128 byte groups
+inline size_t g_GetV210Stride(size_t p_Width)
+{
+	return ((p_Width + 47) / 48) * 128;
+}
+
+enum RGBMatrix
+{
+	rgbMatrixBT709 = 0,
+	rgbMatrixBT2020,
+};
+
+// fixed point RGB > YCbCr setup, input and output use the same sample container, RGB is expected full range
+struct RGBConversion
+{
+	uint32_t numChannels; // 3 for RGB, 4 for RGBA, alpha is ignored
+	uint32_t bytesPerSample; // 1 or 2
+	int32_t coeffsY[3];
+	int32_t coeffsU[3];
+	int32_t coeffsV[3];
+	int32_t offsetY;
+	int32_t offsetC;
+	int32_t maxValue;
+};
+
+void g_InitRGBConversion(RGBMatrix p_Matrix, uint32_t p_NumChannels, uint32_t p_BitsPerSample, bool p_IsFullRange, RGBConversion* p_pConv);
+
+// interleaved RGB(A) > planar YCbCr, p_HSubsampling 1 or 2, with p_pSrc1 set the two rows share one chroma row
+void g_ConvertRGB(const RGBConversion& p_Conv, const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstY0, uint8_t* p_pDstY1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width, uint32_t p_HSubsampling);
+
+// 2x2 box downscale of a row pair into one row of p_Width samples, rounded to nearest
+void g_Downscale2x2_8(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDst, size_t p_Width);
+void g_Downscale2x2_16(const uint16_t* p_pSrc0, const uint16_t* p_pSrc1, uint16_t* p_pDst, size_t p_Width);
+
+// NV12 / P010 chroma row pair > 2x2 downscaled planar U and V, the split and the box filter in one pass
+void g_DownscaleUV8_2x2(const uint8_t* p_pSrc0, const uint8_t* p_pSrc1, uint8_t* p_pDstU, uint8_t* p_pDstV, size_t p_Width);
+void g_DownscaleUV16_2x2(const uint16_t* p_pSrc0, const uint16_t* p_pSrc1, uint16_t* p_pDstU, uint16_t* p_pDstV, size_t p_Width);
+
+// time stamp counter for throughput reports, 0 where the platform has none
+uint64_t g_ReadCycleCounter();
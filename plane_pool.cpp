@@ -0,0 +1,85 @@
+#include "plane_pool.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+void* g_AlignedAlloc(size_t p_Size, size_t p_Alignment)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(p_Size, p_Alignment);
+#else
+	void* pMem = NULL;
+	if (posix_memalign(&pMem, p_Alignment, p_Size) != 0) {
+		return NULL;
+	}
+
+	return pMem;
+#endif
+}
+
+void g_AlignedFree(void* p_pMem)
+{
+#if defined(_WIN32)
+	_aligned_free(p_pMem);
+#else
+	free(p_pMem);
+#endif
+}
+
+PlanePool::PlanePool()
+	: m_NumAllocs(0)
+{
+	for (uint32_t i = 0; i < s_MaxPlanes; ++i) {
+		m_pPlanes[i] = NULL;
+		m_Strides[i] = 0;
+		m_Sizes[i] = 0;
+	}
+}
+
+PlanePool::~PlanePool()
+{
+	Release();
+}
+
+bool PlanePool::Reserve(uint32_t p_PlaneIdx, uint32_t p_RowBytes, uint32_t p_NumRows)
+{
+	if (p_PlaneIdx >= s_MaxPlanes) {
+		return false;
+	}
+
+	const uint32_t stride = (p_RowBytes + s_Alignment - 1) & ~(s_Alignment - 1);
+	const size_t size = static_cast<size_t>(stride) * p_NumRows;
+
+	if ((m_pPlanes[p_PlaneIdx] != NULL) && (size <= m_Sizes[p_PlaneIdx])) {
+		m_Strides[p_PlaneIdx] = stride;
+		return true;
+	}
+
+	g_AlignedFree(m_pPlanes[p_PlaneIdx]);
+
+	m_pPlanes[p_PlaneIdx] = static_cast<uint8_t*>(g_AlignedAlloc(size, s_Alignment));
+	if (m_pPlanes[p_PlaneIdx] == NULL) {
+		m_Strides[p_PlaneIdx] = 0;
+		m_Sizes[p_PlaneIdx] = 0;
+		return false;
+	}
+
+	m_Strides[p_PlaneIdx] = stride;
+	m_Sizes[p_PlaneIdx] = size;
+	++m_NumAllocs;
+
+	return true;
+}
+
+void PlanePool::Release()
+{
+	for (uint32_t i = 0; i < s_MaxPlanes; ++i) {
+		g_AlignedFree(m_pPlanes[i]);
+		m_pPlanes[i] = NULL;
+		m_Strides[i] = 0;
+		m_Sizes[i] = 0;
+	}
+}
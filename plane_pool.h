@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+void* g_AlignedAlloc(size_t p_Size, size_t p_Alignment);
+void g_AlignedFree(void* p_pMem);
+
+// Per-encoder set of 64-byte aligned plane buffers, sized once from the negotiated
+// geometry and reused for every frame. Reserve() only allocates when a plane grows.
+class PlanePool
+{
+public:
+	static const uint32_t s_MaxPlanes = 3;
+	static const uint32_t s_Alignment = 64;
+
+public:
+	PlanePool();
+	~PlanePool();
+
+	bool Reserve(uint32_t p_PlaneIdx, uint32_t p_RowBytes, uint32_t p_NumRows);
+	void Release();
+
+	uint8_t* GetPlane(uint32_t p_PlaneIdx) const
+	{
+		return m_pPlanes[p_PlaneIdx];
+	}
+
+	uint32_t GetStride(uint32_t p_PlaneIdx) const
+	{
+		return m_Strides[p_PlaneIdx];
+	}
+
+	// number of heap allocations done so far, stays constant on the steady-state path
+	uint64_t GetNumAllocs() const
+	{
+		return m_NumAllocs;
+	}
+
+private:
+	PlanePool(const PlanePool& p_Other);
+	PlanePool& operator=(const PlanePool& p_Other);
+
+private:
+	uint8_t* m_pPlanes[s_MaxPlanes];
+	uint32_t m_Strides[s_MaxPlanes];
+	size_t m_Sizes[s_MaxPlanes];
+	uint64_t m_NumAllocs;
+};
@@ -4,6 +4,7 @@
 
 #include <cstring>
 
+#include "mp4_container.h"
 #include "x265_encoder.h"
 
 // NOTE: When creating a plugin for release, please generate a new Plugin UUID in order to prevent conflicts with other third-party plugins.
@@ -24,9 +25,16 @@ StatusCode g_HandleGetInfo(HostPropertyCollectionRef* p_pProps)
 
 StatusCode g_HandleCreateObj(unsigned char* p_pUUID, ObjectRef* p_ppObj)
 {
-    if (memcmp(p_pUUID, X265Encoder::s_UUID, 16) == 0)
+    const X265CodecDesc* pCodec = X265Encoder::s_FindCodec(p_pUUID);
+    if (pCodec != NULL)
     {
-        *p_ppObj = new X265Encoder();
+        *p_ppObj = new X265Encoder(pCodec);
+        return errNone;
+    }
+
+    if (memcmp(p_pUUID, MP4Container::s_UUID, 16) == 0)
+    {
+        *p_ppObj = new MP4Container();
         return errNone;
     }
 
@@ -57,15 +65,15 @@ StatusCode g_ListCodecs(HostListRef* p_pList)
 
 StatusCode g_ListContainers(HostListRef* p_pList)
 {
-    return errNone;
-
+    return MP4Container::s_Register(p_pList);
 }
 
 StatusCode g_GetEncoderSettings(unsigned char* p_pUUID, HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
 {
-    if (memcmp(p_pUUID, X265Encoder::s_UUID, 16) == 0)
+    const X265CodecDesc* pCodec = X265Encoder::s_FindCodec(p_pUUID);
+    if (pCodec != NULL)
     {
-        return X265Encoder::s_GetEncoderSettings(p_pValues, p_pSettingsList);
+        return X265Encoder::s_GetEncoderSettings(pCodec, p_pValues, p_pSettingsList);
     }
 
     return errNoCodec;
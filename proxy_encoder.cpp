@@ -0,0 +1,179 @@
+#include "proxy_encoder.h"
+
+#include <algorithm>
+
+#include "x265.h"
+
+const uint32_t ProxyEncoder::s_MinSize = 64;
+
+// editorial proxies trade quality for speed, the master keeps the bulk of the thread budget
+static const char* s_ProxyPreset = "veryfast";
+static const double s_ProxyCRF = 26;
+static const int s_ProxyFrameThreads = 2;
+
+ProxyEncoder::ProxyEncoder()
+	: m_pAPI(NULL)
+	, m_pParam(NULL)
+	, m_pContext(NULL)
+	, m_IsHashing(false)
+	, m_Width(0)
+	, m_Height(0)
+	, m_NumFrames(0)
+	, m_HasFailed(false)
+{
+}
+
+ProxyEncoder::~ProxyEncoder()
+{
+	Close();
+}
+
+bool ProxyEncoder::Open(const x265_api* p_pAPI, const x265_param* p_pMaster, const std::vector<std::string>& p_Paths, uint32_t p_NumThreads, bool p_IsHashing)
+{
+	Close();
+
+	m_pAPI = p_pAPI;
+	m_Paths = p_Paths;
+	m_IsHashing = p_IsHashing;
+	m_NumFrames = 0;
+	m_HasFailed = false;
+
+	// half size in whole chroma samples, the chroma planes are 2x2 downscaled from the master chroma
+	const uint32_t hSub = (p_pMaster->internalCsp == X265_CSP_I444) ? 1 : 2;
+	const uint32_t vSub = (p_pMaster->internalCsp == X265_CSP_I420) ? 2 : 1;
+	const uint32_t height = p_pMaster->bField ? (2 * p_pMaster->sourceHeight) : p_pMaster->sourceHeight;
+	m_Width = (p_pMaster->sourceWidth / 2) & ~(hSub - 1);
+	m_Height = (height / 2) & ~(vSub - 1);
+	if ((m_Width < s_MinSize) || (m_Height < s_MinSize)) {
+		return false;
+	}
+
+	m_pParam = m_pAPI->param_alloc();
+	if ((m_pParam == NULL) || (m_pAPI->param_default_preset(m_pParam, s_ProxyPreset, NULL) != 0)) {
+		Close();
+		return false;
+	}
+
+	m_pParam->internalCsp = p_pMaster->internalCsp;
+	m_pParam->sourceWidth = m_Width;
+	m_pParam->sourceHeight = m_Height;
+	m_pParam->sourceBitDepth = p_pMaster->sourceBitDepth;
+	// fields are blended into progressive frames at the frame rate
+	m_pParam->fpsNum = p_pMaster->bField ? (p_pMaster->fpsNum / 2) : p_pMaster->fpsNum;
+	m_pParam->fpsDenom = p_pMaster->fpsDenom;
+	m_pParam->vui = p_pMaster->vui;
+	m_pParam->keyframeMax = p_pMaster->keyframeMax;
+	m_pParam->bOpenGOP = p_pMaster->bOpenGOP;
+	m_pParam->bAnnexB = 0;
+	m_pParam->bRepeatHeaders = 1;
+	m_pParam->rc.rateControlMode = X265_RC_CRF;
+	m_pParam->rc.rfConstant = s_ProxyCRF;
+	m_pParam->frameNumThreads = s_ProxyFrameThreads;
+
+	m_NumaPools = std::to_string(std::max<uint32_t>(1, p_NumThreads));
+	m_pParam->numaPools = m_NumaPools.c_str();
+
+	const uint32_t pixelBytes = (p_pMaster->sourceBitDepth > 8) ? 2 : 1;
+	if (!m_Planes.Reserve(0, m_Width * pixelBytes, m_Height) ||
+		!m_Planes.Reserve(1, (m_Width / hSub) * pixelBytes, m_Height / vSub) || !m_Planes.Reserve(2, (m_Width / hSub) * pixelBytes, m_Height / vSub)) {
+		Close();
+		return false;
+	}
+
+	m_pContext = m_pAPI->encoder_open(m_pParam);
+	if (m_pContext == NULL) {
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool ProxyEncoder::WriteNals(const x265_nal* p_pNals, uint32_t p_NumNals)
+{
+	if (p_NumNals == 0) {
+		return true;
+	}
+
+	if (!m_Writer.IsOpen() && !m_Writer.Open(m_Paths, false, m_IsHashing)) {
+		return false;
+	}
+
+	// one access unit, gathered so the writer walks it in one call
+	m_Packet.clear();
+	for (uint32_t i = 0; i < p_NumNals; ++i) {
+		m_Packet.insert(m_Packet.end(), p_pNals[i].payload, p_pNals[i].payload + p_pNals[i].sizeBytes);
+	}
+
+	return m_Writer.WriteNals(m_Packet.data(), m_Packet.size());
+}
+
+bool ProxyEncoder::Encode(int64_t p_PTS, int p_BitDepth)
+{
+	if (!IsOpen() || m_HasFailed) {
+		return false;
+	}
+
+	x265_picture inPic;
+	x265_picture outPic;
+	m_pAPI->picture_init(m_pParam, &inPic);
+	m_pAPI->picture_init(m_pParam, &outPic);
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		inPic.planes[i] = m_Planes.GetPlane(i);
+		inPic.stride[i] = m_Planes.GetStride(i);
+	}
+	// the planes keep the 16-bit containers of the master picture, picture_init only sets the internal depth
+	inPic.bitDepth = p_BitDepth;
+	inPic.pts = p_PTS;
+
+	x265_nal* pNals = NULL;
+	uint32_t numNals = 0;
+	const int ret = m_pAPI->encoder_encode(m_pContext, &pNals, &numNals, &inPic, &outPic);
+	if ((ret < 0) || ((ret > 0) && !WriteNals(pNals, numNals))) {
+		m_HasFailed = true;
+		return false;
+	}
+
+	++m_NumFrames;
+	return true;
+}
+
+bool ProxyEncoder::Finish()
+{
+	if (!IsOpen()) {
+		return false;
+	}
+
+	x265_picture outPic;
+	m_pAPI->picture_init(m_pParam, &outPic);
+
+	int ret = 1;
+	while (!m_HasFailed && (ret > 0)) {
+		x265_nal* pNals = NULL;
+		uint32_t numNals = 0;
+		ret = m_pAPI->encoder_encode(m_pContext, &pNals, &numNals, NULL, &outPic);
+		if ((ret < 0) || ((ret > 0) && !WriteNals(pNals, numNals))) {
+			m_HasFailed = true;
+		}
+	}
+
+	const bool isClosed = m_Writer.Close();
+	return isClosed && !m_HasFailed;
+}
+
+void ProxyEncoder::Close()
+{
+	m_Writer.Close();
+
+	// the master owns the x265 api, its cleanup() runs after every encoder is closed
+	if (m_pContext != NULL) {
+		m_pAPI->encoder_close(m_pContext);
+		m_pContext = NULL;
+	}
+
+	if (m_pParam != NULL) {
+		m_pAPI->param_free(m_pParam);
+		m_pParam = NULL;
+	}
+}
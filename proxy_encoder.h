@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "plane_pool.h"
+#include "stream_writer.h"
+
+struct x265_api;
+struct x265_encoder;
+struct x265_nal;
+struct x265_param;
+
+// Half resolution editorial proxy encoded next to the master from the same host frame. The caller
+// downscales into the planes of this class, the proxy runs its own x265 instance on a share of the
+// plugin's threads and writes an Annex-B stream with repeated parameter sets through a StreamWriter.
+class ProxyEncoder
+{
+public:
+	ProxyEncoder();
+	~ProxyEncoder();
+
+	// takes format, frame rate and GOP length from the master parameters, p_NumThreads is the x265 pool size
+	// p_Paths are the stream and its copies, p_IsHashing has the writer compute an XXH64 of the stream
+	bool Open(const x265_api* p_pAPI, const x265_param* p_pMaster, const std::vector<std::string>& p_Paths, uint32_t p_NumThreads, bool p_IsHashing);
+	// encodes the current planes, p_BitDepth is the sample depth of the master picture they were scaled from
+	bool Encode(int64_t p_PTS, int p_BitDepth);
+	// drains x265 and closes the stream
+	bool Finish();
+	void Close();
+
+	bool IsOpen() const
+	{
+		return (m_pContext != NULL);
+	}
+
+	uint32_t GetWidth() const
+	{
+		return m_Width;
+	}
+
+	uint32_t GetHeight() const
+	{
+		return m_Height;
+	}
+
+	uint8_t* GetPlane(uint32_t p_PlaneIdx) const
+	{
+		return m_Planes.GetPlane(p_PlaneIdx);
+	}
+
+	uint32_t GetStride(uint32_t p_PlaneIdx) const
+	{
+		return m_Planes.GetStride(p_PlaneIdx);
+	}
+
+	uint64_t GetNumFrames() const
+	{
+		return m_NumFrames;
+	}
+
+	const StreamWriter& GetWriter() const
+	{
+		return m_Writer;
+	}
+
+	static const uint32_t s_MinSize;
+
+private:
+	ProxyEncoder(const ProxyEncoder& p_Other);
+	ProxyEncoder& operator=(const ProxyEncoder& p_Other);
+
+	bool WriteNals(const x265_nal* p_pNals, uint32_t p_NumNals);
+
+private:
+	const x265_api* m_pAPI;
+	x265_param* m_pParam;
+	x265_encoder* m_pContext;
+	std::vector<std::string> m_Paths;
+	bool m_IsHashing;
+	std::string m_NumaPools; // x265 keeps the pointer
+	uint32_t m_Width;
+	uint32_t m_Height;
+	PlanePool m_Planes;
+	StreamWriter m_Writer;
+	std::vector<uint8_t> m_Packet;
+	uint64_t m_NumFrames;
+	bool m_HasFailed;
+};
@@ -0,0 +1,203 @@
+#include "stats_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+// frame hash file: magic, frame count, one little-endian XXH64 per frame
+static const char s_FramesMagic[8] = { 'X', '2', '6', '5', 'S', 'C', '1', 0 };
+static const char* s_FramesName = "frames";
+static const char* s_StatsName = "stats";
+
+StatsCache::StatsCache(const std::string& p_Folder, uint64_t p_MaxBytes)
+	: m_Folder(p_Folder)
+	, m_MaxBytes(p_MaxBytes)
+	, m_NumEvicted(0)
+{
+}
+
+std::string StatsCache::GetEntryPath(uint64_t p_PrefixKey, uint64_t p_Key) const
+{
+	char name[40];
+	snprintf(name, sizeof(name), "%016llx-%016llx", static_cast<unsigned long long>(p_PrefixKey), static_cast<unsigned long long>(p_Key));
+	return (std::filesystem::path(m_Folder) / name).string();
+}
+
+bool StatsCache::ReadFrameHashes(const std::string& p_EntryPath, std::vector<uint64_t>* p_pFrameHashes) const
+{
+	std::ifstream framesFile(std::filesystem::path(p_EntryPath) / s_FramesName, std::ios::in | std::ios::binary);
+	char magic[sizeof(s_FramesMagic)];
+	uint64_t numFrames = 0;
+	if (!framesFile.read(magic, sizeof(magic)) || (memcmp(magic, s_FramesMagic, sizeof(magic)) != 0) ||
+		!framesFile.read(reinterpret_cast<char*>(&numFrames), sizeof(numFrames))) {
+		return false;
+	}
+
+	p_pFrameHashes->resize(numFrames);
+	if ((numFrames > 0) && !framesFile.read(reinterpret_cast<char*>(p_pFrameHashes->data()), numFrames * sizeof(uint64_t))) {
+		p_pFrameHashes->clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool StatsCache::Find(uint64_t p_PrefixKey, const std::vector<std::string>& p_Suffixes, std::vector<Entry>* p_pEntries) const
+{
+	char prefix[20];
+	snprintf(prefix, sizeof(prefix), "%016llx-", static_cast<unsigned long long>(p_PrefixKey));
+
+	p_pEntries->clear();
+	std::error_code err;
+	for (std::filesystem::directory_iterator it(m_Folder, err), end; !err && (it != end); it.increment(err)) {
+		const std::string name = it->path().filename().string();
+		if ((name.size() != 33) || (name.compare(0, 17, prefix) != 0) || !it->is_directory(err)) {
+			continue;
+		}
+
+		bool isComplete = true;
+		for (const std::string& suffix : p_Suffixes) {
+			isComplete = isComplete && std::filesystem::is_regular_file(it->path() / (s_StatsName + suffix), err);
+		}
+
+		Entry entry;
+		entry.key = strtoull(name.c_str() + 17, NULL, 16);
+		if (isComplete && ReadFrameHashes(it->path().string(), &entry.frameHashes)) {
+			p_pEntries->push_back(entry);
+		}
+	}
+
+	return !p_pEntries->empty();
+}
+
+bool StatsCache::Load(uint64_t p_PrefixKey, uint64_t p_Key, const std::string& p_StatPath, const std::vector<std::string>& p_Suffixes) const
+{
+	const std::filesystem::path entryPath(GetEntryPath(p_PrefixKey, p_Key));
+	std::error_code err;
+
+	// copied next to the stat files first, the files in place are only replaced once every copy is complete
+	const std::string tempSuffix = ".cached";
+	for (const std::string& suffix : p_Suffixes) {
+		if (!std::filesystem::copy_file(entryPath / (s_StatsName + suffix), p_StatPath + suffix + tempSuffix, std::filesystem::copy_options::overwrite_existing, err)) {
+			for (const std::string& removeSuffix : p_Suffixes) {
+				std::filesystem::remove(p_StatPath + removeSuffix + tempSuffix, err);
+			}
+			return false;
+		}
+	}
+
+	for (const std::string& suffix : p_Suffixes) {
+		std::filesystem::rename(p_StatPath + suffix + tempSuffix, p_StatPath + suffix, err);
+		if (err) {
+			return false;
+		}
+	}
+
+	// the modification time of the hash file is the last use of the entry
+	std::filesystem::last_write_time(entryPath / s_FramesName, std::filesystem::file_time_type::clock::now(), err);
+	return true;
+}
+
+bool StatsCache::Store(uint64_t p_PrefixKey, uint64_t p_Key, const std::vector<uint64_t>& p_FrameHashes, const std::string& p_StatPath,
+	const std::vector<std::string>& p_Suffixes)
+{
+	std::error_code err;
+	std::filesystem::create_directories(m_Folder, err);
+
+	// filled under a name of its own and renamed, exports of the same timeline may finish together
+	std::random_device random;
+	char token[20];
+	snprintf(token, sizeof(token), ".%08x.tmp", static_cast<uint32_t>(random()));
+	const std::string entryPath = GetEntryPath(p_PrefixKey, p_Key);
+	const std::filesystem::path tempPath(entryPath + token);
+	if (!std::filesystem::create_directory(tempPath, err)) {
+		return false;
+	}
+
+	bool isOk = true;
+	for (const std::string& suffix : p_Suffixes) {
+		if (!std::filesystem::copy_file(p_StatPath + suffix, tempPath / (s_StatsName + suffix), err)) {
+			isOk = false;
+			break;
+		}
+	}
+
+	if (isOk) {
+		const uint64_t numFrames = p_FrameHashes.size();
+		std::ofstream framesFile(tempPath / s_FramesName, std::ios::out | std::ios::binary | std::ios::trunc);
+		framesFile.write(s_FramesMagic, sizeof(s_FramesMagic));
+		framesFile.write(reinterpret_cast<const char*>(&numFrames), sizeof(numFrames));
+		framesFile.write(reinterpret_cast<const char*>(p_FrameHashes.data()), numFrames * sizeof(uint64_t));
+		framesFile.close();
+		isOk = !!framesFile;
+	}
+
+	// an entry of the same keys is replaced, it holds the same frames or collided with them
+	if (isOk) {
+		std::filesystem::remove_all(entryPath, err);
+		std::filesystem::rename(tempPath, entryPath, err);
+		isOk = !err;
+	}
+
+	if (!isOk) {
+		std::filesystem::remove_all(tempPath, err);
+		return false;
+	}
+
+	Evict(entryPath);
+	return true;
+}
+
+void StatsCache::Evict(const std::string& p_KeepEntry)
+{
+	struct Entry
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type lastUse;
+		uint64_t numBytes;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t totalBytes = 0;
+	std::error_code err;
+	for (std::filesystem::directory_iterator it(m_Folder, err), end; !err && (it != end); it.increment(err)) {
+		if (!it->is_directory(err) || (it->path().extension() == ".tmp")) {
+			continue;
+		}
+
+		Entry entry = { it->path(), std::filesystem::last_write_time(it->path() / s_FramesName, err), 0 };
+		if (err) {
+			entry.lastUse = std::filesystem::file_time_type::min();
+		}
+		for (std::filesystem::directory_iterator fileIt(it->path(), err), fileEnd; !err && (fileIt != fileEnd); fileIt.increment(err)) {
+			entry.numBytes += fileIt->file_size(err);
+		}
+		err.clear();
+
+		totalBytes += entry.numBytes;
+		entries.push_back(entry);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& p_Lhs, const Entry& p_Rhs) { return p_Lhs.lastUse < p_Rhs.lastUse; });
+
+	// the entry just stored stays even when it alone is over the cap
+	for (const Entry& entry : entries) {
+		if (totalBytes <= m_MaxBytes) {
+			break;
+		}
+
+		if (entry.path == std::filesystem::path(p_KeepEntry)) {
+			continue;
+		}
+
+		std::filesystem::remove_all(entry.path, err);
+		totalBytes -= entry.numBytes;
+		++m_NumEvicted;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Persistent cache of first pass statistics. An entry is a sub folder holding the stat files of one first pass
+// and the content hashes of the frames it saw. It is named after two keys: the prefix key covers the opening
+// frames, so an export can pick its candidates early in the pass, the key covers the whole timeline and tells
+// apart timelines that only share their opening. The least recently used entries go once the cache exceeds its cap.
+class StatsCache
+{
+public:
+	struct Entry
+	{
+		uint64_t key;
+		std::vector<uint64_t> frameHashes;
+	};
+
+public:
+	StatsCache(const std::string& p_Folder, uint64_t p_MaxBytes);
+
+	// reads the complete entries of p_PrefixKey with their frame hashes, false when there is none
+	bool Find(uint64_t p_PrefixKey, const std::vector<std::string>& p_Suffixes, std::vector<Entry>* p_pEntries) const;
+	// replaces p_StatPath + suffix with the stat files of the entry and marks the entry as used, the files
+	// in place stay untouched when a copy fails
+	bool Load(uint64_t p_PrefixKey, uint64_t p_Key, const std::string& p_StatPath, const std::vector<std::string>& p_Suffixes) const;
+	// stores p_StatPath + suffix as the entry of the two keys, then evicts the least recently used entries over the cap
+	bool Store(uint64_t p_PrefixKey, uint64_t p_Key, const std::vector<uint64_t>& p_FrameHashes, const std::string& p_StatPath,
+		const std::vector<std::string>& p_Suffixes);
+
+	const std::string& GetFolder() const
+	{
+		return m_Folder;
+	}
+
+	uint64_t GetNumEvicted() const
+	{
+		return m_NumEvicted;
+	}
+
+private:
+	std::string GetEntryPath(uint64_t p_PrefixKey, uint64_t p_Key) const;
+	bool ReadFrameHashes(const std::string& p_EntryPath, std::vector<uint64_t>* p_pFrameHashes) const;
+	void Evict(const std::string& p_KeepEntry);
+
+private:
+	std::string m_Folder;
+	uint64_t m_MaxBytes;
+	uint64_t m_NumEvicted;
+};
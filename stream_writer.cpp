@@ -0,0 +1,687 @@
+#include "stream_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define STREAM_WRITER_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "plane_pool.h"
+
+const size_t StreamWriter::s_BufferSize = 4 << 20;
+const size_t StreamWriter::s_Alignment = 4096;
+const uint32_t StreamWriter::s_QueueDepth = 8;
+const uint32_t StreamWriter::s_MaxQueuedBuffers = 64;
+
+static const uint8_t s_StartCode[] = { 0, 0, 0, 1 };
+
+#if defined(STREAM_WRITER_IO_URING)
+
+// Minimal io_uring over the raw system calls, one submitter and one reaper (the writer thread).
+// Only IORING_OP_WRITE is used, kernels without it report -EINVAL per request and the writer
+// falls back to synchronous writes.
+class IOURing
+{
+public:
+	IOURing()
+		: m_RingFD(-1)
+		, m_pSQRing(MAP_FAILED)
+		, m_pCQRing(MAP_FAILED)
+		, m_pSQEs(MAP_FAILED)
+		, m_SQRingSize(0)
+		, m_CQRingSize(0)
+		, m_SQEsSize(0)
+		, m_NumEntries(0)
+		, m_ToSubmit(0)
+		, m_pSQHead(NULL)
+		, m_pSQTail(NULL)
+		, m_SQMask(0)
+		, m_pSQArray(NULL)
+		, m_pCQHead(NULL)
+		, m_pCQTail(NULL)
+		, m_CQMask(0)
+		, m_pCQEs(NULL)
+	{
+	}
+
+	~IOURing()
+	{
+		if (m_pSQEs != MAP_FAILED) {
+			munmap(m_pSQEs, m_SQEsSize);
+		}
+		if ((m_pCQRing != MAP_FAILED) && (m_pCQRing != m_pSQRing)) {
+			munmap(m_pCQRing, m_CQRingSize);
+		}
+		if (m_pSQRing != MAP_FAILED) {
+			munmap(m_pSQRing, m_SQRingSize);
+		}
+		if (m_RingFD >= 0) {
+			close(m_RingFD);
+		}
+	}
+
+	bool Setup(uint32_t p_NumEntries)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		m_RingFD = static_cast<int>(syscall(__NR_io_uring_setup, p_NumEntries, &params));
+		if (m_RingFD < 0) {
+			return false;
+		}
+
+		m_NumEntries = params.sq_entries;
+		m_SQRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		m_CQRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool isSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (isSingleMap) {
+			m_SQRingSize = m_CQRingSize = std::max(m_SQRingSize, m_CQRingSize);
+		}
+
+		m_pSQRing = mmap(NULL, m_SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFD, IORING_OFF_SQ_RING);
+		if (m_pSQRing == MAP_FAILED) {
+			return false;
+		}
+
+		m_pCQRing = isSingleMap ? m_pSQRing : mmap(NULL, m_CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFD, IORING_OFF_CQ_RING);
+		if (m_pCQRing == MAP_FAILED) {
+			return false;
+		}
+
+		m_SQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_pSQEs = mmap(NULL, m_SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFD, IORING_OFF_SQES);
+		if (m_pSQEs == MAP_FAILED) {
+			return false;
+		}
+
+		uint8_t* pSQ = static_cast<uint8_t*>(m_pSQRing);
+		m_pSQHead = reinterpret_cast<uint32_t*>(pSQ + params.sq_off.head);
+		m_pSQTail = reinterpret_cast<uint32_t*>(pSQ + params.sq_off.tail);
+		m_SQMask = *reinterpret_cast<uint32_t*>(pSQ + params.sq_off.ring_mask);
+		m_pSQArray = reinterpret_cast<uint32_t*>(pSQ + params.sq_off.array);
+
+		uint8_t* pCQ = static_cast<uint8_t*>(m_pCQRing);
+		m_pCQHead = reinterpret_cast<uint32_t*>(pCQ + params.cq_off.head);
+		m_pCQTail = reinterpret_cast<uint32_t*>(pCQ + params.cq_off.tail);
+		m_CQMask = *reinterpret_cast<uint32_t*>(pCQ + params.cq_off.ring_mask);
+		m_pCQEs = reinterpret_cast<io_uring_cqe*>(pCQ + params.cq_off.cqes);
+
+		return true;
+	}
+
+	bool QueueWrite(int p_FD, const void* p_pData, uint32_t p_Size, uint64_t p_Offset, uint64_t p_UserData)
+	{
+		const uint32_t tail = *m_pSQTail;
+		if (tail - __atomic_load_n(m_pSQHead, __ATOMIC_ACQUIRE) >= m_NumEntries) {
+			return false;
+		}
+
+		const uint32_t idx = tail & m_SQMask;
+		io_uring_sqe* pSQE = static_cast<io_uring_sqe*>(m_pSQEs) + idx;
+		memset(pSQE, 0, sizeof(*pSQE));
+		pSQE->opcode = IORING_OP_WRITE;
+		pSQE->fd = p_FD;
+		pSQE->addr = reinterpret_cast<uint64_t>(p_pData);
+		pSQE->len = p_Size;
+		pSQE->off = p_Offset;
+		pSQE->user_data = p_UserData;
+		m_pSQArray[idx] = idx;
+
+		__atomic_store_n(m_pSQTail, tail + 1, __ATOMIC_RELEASE);
+		++m_ToSubmit;
+		return true;
+	}
+
+	// submits the queued requests, waits for p_MinComplete completions
+	bool Enter(uint32_t p_MinComplete)
+	{
+		for (;;) {
+			const long ret = syscall(__NR_io_uring_enter, m_RingFD, m_ToSubmit, p_MinComplete, (p_MinComplete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+			if (ret >= 0) {
+				m_ToSubmit -= std::min<uint32_t>(m_ToSubmit, static_cast<uint32_t>(ret));
+				return true;
+			}
+
+			if (errno != EINTR) {
+				return false;
+			}
+		}
+	}
+
+	bool PopCompletion(uint64_t* p_pUserData, int32_t* p_pResult)
+	{
+		const uint32_t head = *m_pCQHead;
+		if (head == __atomic_load_n(m_pCQTail, __ATOMIC_ACQUIRE)) {
+			return false;
+		}
+
+		const io_uring_cqe& cqe = m_pCQEs[head & m_CQMask];
+		*p_pUserData = cqe.user_data;
+		*p_pResult = cqe.res;
+
+		__atomic_store_n(m_pCQHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+private:
+	int m_RingFD;
+	void* m_pSQRing;
+	void* m_pCQRing;
+	void* m_pSQEs;
+	size_t m_SQRingSize;
+	size_t m_CQRingSize;
+	size_t m_SQEsSize;
+	uint32_t m_NumEntries;
+	uint32_t m_ToSubmit;
+
+	uint32_t* m_pSQHead;
+	uint32_t* m_pSQTail;
+	uint32_t m_SQMask;
+	uint32_t* m_pSQArray;
+	uint32_t* m_pCQHead;
+	uint32_t* m_pCQTail;
+	uint32_t m_CQMask;
+	io_uring_cqe* m_pCQEs;
+};
+
+#else
+
+class IOURing
+{
+};
+
+#endif
+
+StreamWriter::StreamWriter()
+	: m_IsOpen(false)
+	, m_pCurrent(NULL)
+	, m_StreamOffset(0)
+	, m_MaxQueueDepth(0)
+	, m_IsStopping(false)
+	, m_IsHashing(false)
+	, m_HashSeconds(0)
+{
+}
+
+StreamWriter::~StreamWriter()
+{
+	Close();
+
+	for (std::unique_ptr<Buffer>& pBuffer : m_Buffers) {
+		g_AlignedFree(pBuffer->pData);
+	}
+}
+
+bool StreamWriter::Open(const std::string& p_Path, bool p_IsDirect)
+{
+	return Open(std::vector<std::string>(1, p_Path), p_IsDirect, false);
+}
+
+bool StreamWriter::OpenDestination(Destination* p_pDest, bool p_IsDirect)
+{
+	const char* pPath = p_pDest->path.c_str();
+
+#if defined(_WIN32)
+	p_pDest->fd = _open(pPath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+	(void)p_IsDirect;
+#else
+	// a FIFO opens like a file, it blocks until the reading end is there
+	struct stat info;
+	p_pDest->isPipe = (stat(pPath, &info) == 0) && !S_ISREG(info.st_mode);
+
+	const int flags = O_WRONLY | O_CREAT | (p_pDest->isPipe ? 0 : O_TRUNC);
+#if defined(O_DIRECT)
+	// file systems without direct I/O (tmpfs, some network mounts) refuse the flag, buffered writes still work there
+	if (p_IsDirect && !p_pDest->isPipe) {
+		p_pDest->fd = open(pPath, flags | O_DIRECT, 0644);
+		p_pDest->isDirect = (p_pDest->fd >= 0);
+	}
+#endif
+	if (p_pDest->fd < 0) {
+		p_pDest->fd = open(pPath, flags, 0644);
+	}
+#if defined(__APPLE__)
+	if (p_IsDirect && !p_pDest->isPipe && (p_pDest->fd >= 0)) {
+		p_pDest->isDirect = (fcntl(p_pDest->fd, F_NOCACHE, 1) == 0);
+	}
+#endif
+#endif
+
+	if (p_pDest->fd < 0) {
+		return false;
+	}
+
+#if defined(STREAM_WRITER_IO_URING)
+	if (!p_pDest->isPipe) {
+		p_pDest->pRing.reset(new IOURing());
+		p_pDest->isUsingRing = p_pDest->pRing->Setup(s_QueueDepth);
+		if (!p_pDest->isUsingRing) {
+			p_pDest->pRing.reset();
+		}
+	}
+#endif
+
+	return true;
+}
+
+bool StreamWriter::Open(const std::vector<std::string>& p_Paths, bool p_IsDirect, bool p_IsHashing)
+{
+	if (m_IsOpen || p_Paths.empty()) {
+		return false;
+	}
+
+	m_Destinations.clear();
+	for (const std::string& path : p_Paths) {
+		std::unique_ptr<Destination> pDest(new Destination());
+		pDest->path = path;
+		pDest->fd = -1;
+		pDest->isDirect = false;
+		pDest->isPipe = false;
+		pDest->isUsingRing = false;
+		pDest->numInFlight = 0;
+		pDest->isOverrun = false;
+		pDest->writeSeconds = 0;
+		pDest->bytesWritten = 0;
+		pDest->hasFailed = false;
+
+		const bool isOpened = OpenDestination(pDest.get(), p_IsDirect);
+		m_Destinations.push_back(std::move(pDest));
+		if (!isOpened) {
+			CloseFiles();
+			return false;
+		}
+	}
+
+	m_StreamOffset = 0;
+	m_Overruns.clear();
+	m_pCurrent = AcquireBuffer();
+	if (m_pCurrent == NULL) {
+		CloseFiles();
+		return false;
+	}
+
+	m_IsStopping = false;
+	m_IsOpen = true;
+	for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+		pDest->thread = std::thread(&StreamWriter::WriterLoop, this, pDest.get());
+	}
+
+	m_IsHashing = p_IsHashing;
+	m_Hasher.Reset();
+	m_HashSeconds = 0;
+	if (m_IsHashing) {
+		m_HashThread = std::thread(&StreamWriter::HashLoop, this);
+	}
+
+	return true;
+}
+
+bool StreamWriter::HasFailed() const
+{
+	for (const std::unique_ptr<Destination>& pDest : m_Destinations) {
+		if (pDest->hasFailed) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+StreamWriter::Buffer* StreamWriter::AcquireBuffer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Free.empty()) {
+			Buffer* pBuffer = m_Free.back();
+			m_Free.pop_back();
+			pBuffer->size = 0;
+			return pBuffer;
+		}
+	}
+
+	std::unique_ptr<Buffer> pBuffer(new Buffer());
+	pBuffer->pData = static_cast<uint8_t*>(g_AlignedAlloc(s_BufferSize, s_Alignment));
+	pBuffer->size = 0;
+	pBuffer->offset = 0;
+	pBuffer->numRefs = 0;
+	if (pBuffer->pData == NULL) {
+		return NULL;
+	}
+
+	m_Buffers.push_back(std::move(pBuffer));
+	return m_Buffers.back().get();
+}
+
+void StreamWriter::ReleaseBuffer(Buffer* p_pBuffer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (--p_pBuffer->numRefs == 0) {
+		m_Free.push_back(p_pBuffer);
+	}
+}
+
+void StreamWriter::QueueCurrent()
+{
+	if ((m_pCurrent == NULL) || (m_pCurrent->size == 0)) {
+		return;
+	}
+
+	m_pCurrent->offset = m_StreamOffset;
+	m_StreamOffset += m_pCurrent->size;
+
+	// one buffer feeds every destination, nothing is copied per destination
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_pCurrent->numRefs = m_IsHashing ? 1 : 0;
+		for (uint32_t destIdx = 0; destIdx < m_Destinations.size(); ++destIdx) {
+			Destination* pDest = m_Destinations[destIdx].get();
+			if (pDest->hasFailed) {
+				continue;
+			}
+
+			// a reader that stopped taking data would otherwise keep the whole stream in memory
+			if (pDest->queue.size() + pDest->numInFlight >= s_MaxQueuedBuffers) {
+				pDest->hasFailed = true;
+				pDest->isOverrun = true;
+				m_Overruns.push_back(destIdx);
+				for (Buffer* pBuffer : pDest->queue) {
+					if (--pBuffer->numRefs == 0) {
+						m_Free.push_back(pBuffer);
+					}
+				}
+				pDest->queue.clear();
+				continue;
+			}
+
+			pDest->queue.push_back(m_pCurrent);
+			++m_pCurrent->numRefs;
+			m_MaxQueueDepth = std::max<uint32_t>(m_MaxQueueDepth, static_cast<uint32_t>(pDest->queue.size()) + pDest->numInFlight);
+		}
+		if (m_IsHashing) {
+			m_HashQueue.push_back(m_pCurrent);
+		}
+		if (m_pCurrent->numRefs == 0) {
+			m_Free.push_back(m_pCurrent);
+		}
+	}
+
+	for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+		pDest->queueCond.notify_one();
+	}
+	if (m_IsHashing) {
+		m_HashCond.notify_one();
+	}
+	m_pCurrent = NULL;
+}
+
+void StreamWriter::Append(const uint8_t* p_pData, size_t p_Size)
+{
+	while (p_Size > 0) {
+		if (m_pCurrent == NULL) {
+			// nothing comes back from the writers yet, the pool grows rather than the encoder waiting
+			m_pCurrent = AcquireBuffer();
+			if (m_pCurrent == NULL) {
+				for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+					pDest->hasFailed = true;
+				}
+				return;
+			}
+		}
+
+		const size_t numCopy = std::min(p_Size, s_BufferSize - m_pCurrent->size);
+		memcpy(m_pCurrent->pData + m_pCurrent->size, p_pData, numCopy);
+		m_pCurrent->size += numCopy;
+		p_pData += numCopy;
+		p_Size -= numCopy;
+
+		if (m_pCurrent->size == s_BufferSize) {
+			QueueCurrent();
+		}
+	}
+}
+
+bool StreamWriter::WriteNals(const uint8_t* p_pData, size_t p_Size)
+{
+	if (!m_IsOpen) {
+		return false;
+	}
+
+	// the start code takes the place of the length, the stream keeps the size of the packet
+	while (p_Size >= 4) {
+		const size_t nalSize = (static_cast<size_t>(p_pData[0]) << 24) | (static_cast<size_t>(p_pData[1]) << 16) |
+							   (static_cast<size_t>(p_pData[2]) << 8) | p_pData[3];
+		if (nalSize > p_Size - 4) {
+			return false;
+		}
+
+		Append(s_StartCode, sizeof(s_StartCode));
+		Append(p_pData + 4, nalSize);
+		p_pData += 4 + nalSize;
+		p_Size -= 4 + nalSize;
+	}
+
+	return (p_Size == 0);
+}
+
+bool StreamWriter::WriteSync(Destination* p_pDest, const Buffer* p_pBuffer, size_t p_Done)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	bool isOk = true;
+	while (p_Done < p_pBuffer->size) {
+#if defined(_WIN32)
+		// there is no ring on Windows, buffers go out in queue order and the offset is implied
+		const int ret = _write(p_pDest->fd, p_pBuffer->pData + p_Done, static_cast<unsigned int>(p_pBuffer->size - p_Done));
+#else
+		const ssize_t ret = p_pDest->isPipe ? write(p_pDest->fd, p_pBuffer->pData + p_Done, p_pBuffer->size - p_Done)
+											: pwrite(p_pDest->fd, p_pBuffer->pData + p_Done, p_pBuffer->size - p_Done, static_cast<off_t>(p_pBuffer->offset + p_Done));
+#endif
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			isOk = false;
+			break;
+		}
+
+		p_pDest->bytesWritten += static_cast<uint64_t>(ret);
+		p_Done += static_cast<size_t>(ret);
+	}
+
+	p_pDest->writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	return isOk;
+}
+
+void StreamWriter::Reap(Destination* p_pDest, uint32_t p_MinComplete)
+{
+#if defined(STREAM_WRITER_IO_URING)
+	const auto startTime = std::chrono::steady_clock::now();
+	const bool isEntered = p_pDest->pRing->Enter(p_MinComplete);
+	p_pDest->writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	if (!isEntered) {
+		// the ring is unusable, the buffers it holds stay out of the pool until the writer goes
+		p_pDest->hasFailed = true;
+		p_pDest->isUsingRing = false;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		p_pDest->numInFlight = 0;
+		return;
+	}
+
+	uint64_t userData = 0;
+	int32_t result = 0;
+	while (p_pDest->pRing->PopCompletion(&userData, &result)) {
+		Buffer* pBuffer = reinterpret_cast<Buffer*>(userData);
+		if (result > 0) {
+			p_pDest->bytesWritten += static_cast<uint64_t>(result);
+		}
+
+		// short or refused writes (kernels before IORING_OP_WRITE) are finished synchronously
+		const size_t numDone = (result > 0) ? static_cast<size_t>(result) : 0;
+		if ((numDone < pBuffer->size) && !WriteSync(p_pDest, pBuffer, numDone)) {
+			p_pDest->hasFailed = true;
+		}
+
+		ReleaseBuffer(pBuffer);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		--p_pDest->numInFlight;
+	}
+#else
+	(void)p_pDest;
+	(void)p_MinComplete;
+#endif
+}
+
+void StreamWriter::WriterLoop(Destination* p_pDest)
+{
+	std::vector<Buffer*> batch;
+	batch.reserve(s_QueueDepth);
+
+	for (;;) {
+		bool isStopping = false;
+		batch.clear();
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			if (p_pDest->numInFlight == 0) {
+				p_pDest->queueCond.wait(lock, [this, p_pDest] { return m_IsStopping || !p_pDest->queue.empty(); });
+			}
+
+			while (!p_pDest->queue.empty() && (p_pDest->numInFlight + batch.size() < s_QueueDepth)) {
+				batch.push_back(p_pDest->queue.front());
+				p_pDest->queue.pop_front();
+			}
+
+			isStopping = m_IsStopping && p_pDest->queue.empty();
+		}
+
+		uint32_t numQueued = 0;
+		for (Buffer* pBuffer : batch) {
+			// a failed destination keeps draining so the other destinations get the buffers back
+			if (p_pDest->hasFailed) {
+				ReleaseBuffer(pBuffer);
+				continue;
+			}
+
+#if defined(STREAM_WRITER_IO_URING)
+			// O_DIRECT takes whole blocks only, so the unaligned tail of the stream is left to the sync path
+			const bool isAligned = !p_pDest->isDirect || ((pBuffer->size % s_Alignment) == 0);
+			if (p_pDest->isUsingRing && isAligned &&
+				p_pDest->pRing->QueueWrite(p_pDest->fd, pBuffer->pData, static_cast<uint32_t>(pBuffer->size), pBuffer->offset, reinterpret_cast<uint64_t>(pBuffer))) {
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				++p_pDest->numInFlight;
+				++numQueued;
+				continue;
+			}
+#endif
+
+			if (p_pDest->isDirect && ((pBuffer->size % s_Alignment) != 0)) {
+				// everything in front of the tail has to land before the file leaves direct mode
+				while (p_pDest->numInFlight > 0) {
+					Reap(p_pDest, 1);
+				}
+#if defined(O_DIRECT)
+				fcntl(p_pDest->fd, F_SETFL, fcntl(p_pDest->fd, F_GETFL) & ~O_DIRECT);
+#endif
+				p_pDest->isDirect = false;
+			}
+
+			if (!WriteSync(p_pDest, pBuffer, 0)) {
+				p_pDest->hasFailed = true;
+			}
+			ReleaseBuffer(pBuffer);
+		}
+
+		if (p_pDest->isUsingRing) {
+			// submit the new writes, block on a completion only when there is nothing else to submit
+			Reap(p_pDest, ((numQueued == 0) && (p_pDest->numInFlight > 0)) ? 1 : 0);
+		}
+
+		if (isStopping && (p_pDest->numInFlight == 0)) {
+			break;
+		}
+	}
+}
+
+void StreamWriter::HashLoop()
+{
+	for (;;) {
+		Buffer* pBuffer = NULL;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_HashCond.wait(lock, [this] { return m_IsStopping || !m_HashQueue.empty(); });
+			if (m_HashQueue.empty()) {
+				break;
+			}
+
+			pBuffer = m_HashQueue.front();
+			m_HashQueue.pop_front();
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+		m_Hasher.Update(pBuffer->pData, pBuffer->size);
+		m_HashSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		ReleaseBuffer(pBuffer);
+	}
+}
+
+void StreamWriter::CloseFiles()
+{
+	for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+		pDest->pRing.reset();
+		if (pDest->fd >= 0) {
+#if defined(_WIN32)
+			if (_close(pDest->fd) != 0) {
+#else
+			if (close(pDest->fd) != 0) {
+#endif
+				pDest->hasFailed = true;
+			}
+			pDest->fd = -1;
+		}
+	}
+}
+
+bool StreamWriter::Close()
+{
+	if (!m_IsOpen) {
+		return true;
+	}
+
+	QueueCurrent();
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+	for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+		pDest->queueCond.notify_one();
+	}
+	for (std::unique_ptr<Destination>& pDest : m_Destinations) {
+		pDest->thread.join();
+	}
+	if (m_IsHashing) {
+		m_HashCond.notify_one();
+		m_HashThread.join();
+	}
+
+	m_IsOpen = false;
+	CloseFiles();
+
+	return !HasFailed();
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xxhash64.h"
+
+class IOURing;
+
+// Asynchronous Annex-B elementary stream writer. The encoder thread copies access units into large
+// aligned buffers and hands full ones to a writer thread per destination, which submits them through
+// io_uring on Linux and with plain writes elsewhere. With several destinations every writer reads the
+// same buffer, which goes back to the pool once the last of them is done with it. The encoder thread
+// never waits on the disk, when it outpaces a destination the buffer pool grows instead, up to
+// s_MaxQueuedBuffers for that destination. Past that the destination is dropped as failed and the others
+// go on, so a stalled reader or a hung mount cannot hold the whole stream in memory. An optional XXH64
+// of the stream is computed the same way, by one more thread reading the shared buffers.
+class StreamWriter
+{
+public:
+	static const size_t s_BufferSize;
+	static const size_t s_Alignment; // O_DIRECT needs block aligned memory, sizes and offsets
+	static const uint32_t s_QueueDepth; // writes in flight per destination
+	static const uint32_t s_MaxQueuedBuffers; // queued and in flight per destination before it is dropped
+
+public:
+	StreamWriter();
+	~StreamWriter();
+
+	bool Open(const std::string& p_Path, bool p_IsDirect);
+	// the same stream to every path, a destination that fails later does not stop the others
+	bool Open(const std::vector<std::string>& p_Paths, bool p_IsDirect, bool p_IsHashing = false);
+	// p_pData holds NAL units with 4 byte big-endian lengths, they are written with start codes
+	bool WriteNals(const uint8_t* p_pData, size_t p_Size);
+	// drains the queues and waits for the writer threads
+	bool Close();
+
+	bool IsOpen() const
+	{
+		return m_IsOpen;
+	}
+
+	// true once any destination failed
+	bool HasFailed() const;
+
+	uint32_t GetNumDestinations() const
+	{
+		return static_cast<uint32_t>(m_Destinations.size());
+	}
+
+	const std::string& GetPath(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->path;
+	}
+
+	bool IsUsingIOURing(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->isUsingRing;
+	}
+
+	bool IsDirect(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->isDirect;
+	}
+
+	bool IsPipe(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->isPipe;
+	}
+
+	bool HasFailed(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->hasFailed.load();
+	}
+
+	// true when the destination fell s_MaxQueuedBuffers behind and was dropped
+	bool IsOverrun(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->isOverrun;
+	}
+
+	// destinations dropped so far in the order they fell behind, encoder thread only
+	uint32_t GetNumOverruns() const
+	{
+		return static_cast<uint32_t>(m_Overruns.size());
+	}
+
+	uint32_t GetOverrun(uint32_t p_Idx) const
+	{
+		return m_Overruns[p_Idx];
+	}
+
+	uint64_t GetBytesWritten(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->bytesWritten.load();
+	}
+
+	// writer thread time spent waiting on the file system, valid after Close()
+	double GetWriteSeconds(uint32_t p_DestIdx) const
+	{
+		return m_Destinations[p_DestIdx]->writeSeconds;
+	}
+
+	// buffers queued or in flight for the slowest destination at the worst point, each one is s_BufferSize
+	uint32_t GetMaxQueueDepth() const
+	{
+		return m_MaxQueueDepth;
+	}
+
+	uint32_t GetNumBuffers() const
+	{
+		return static_cast<uint32_t>(m_Buffers.size());
+	}
+
+	bool IsHashing() const
+	{
+		return m_IsHashing;
+	}
+
+	// XXH64 of every byte of the stream, valid after Close()
+	uint64_t GetDigest() const
+	{
+		return m_Hasher.GetDigest();
+	}
+
+	// hash thread time, valid after Close()
+	double GetHashSeconds() const
+	{
+		return m_HashSeconds;
+	}
+
+private:
+	struct Buffer
+	{
+		uint8_t* pData;
+		size_t size;
+		uint64_t offset; // stream position, the same in every destination
+		uint32_t numRefs; // destinations and the hasher still holding the buffer, guarded by m_Mutex
+	};
+
+	struct Destination
+	{
+		std::string path;
+		int fd;
+		bool isDirect;
+		bool isPipe; // written in order without offsets, no ring and no direct I/O
+		bool isUsingRing;
+		std::unique_ptr<IOURing> pRing;
+		std::thread thread;
+
+		// guarded by m_Mutex
+		std::condition_variable queueCond;
+		std::deque<Buffer*> queue;
+		uint32_t numInFlight;
+		bool isOverrun;
+
+		// writer thread side
+		double writeSeconds;
+		std::atomic<uint64_t> bytesWritten;
+		std::atomic<bool> hasFailed;
+	};
+
+private:
+	StreamWriter(const StreamWriter& p_Other);
+	StreamWriter& operator=(const StreamWriter& p_Other);
+
+	bool OpenDestination(Destination* p_pDest, bool p_IsDirect);
+	void CloseFiles();
+
+	void Append(const uint8_t* p_pData, size_t p_Size);
+	void QueueCurrent();
+	Buffer* AcquireBuffer();
+	void ReleaseBuffer(Buffer* p_pBuffer);
+
+	void WriterLoop(Destination* p_pDest);
+	void HashLoop();
+	void Reap(Destination* p_pDest, uint32_t p_MinComplete);
+	bool WriteSync(Destination* p_pDest, const Buffer* p_pBuffer, size_t p_Done);
+
+private:
+	bool m_IsOpen;
+	std::vector<std::unique_ptr<Destination>> m_Destinations;
+
+	// encoder thread side
+	std::vector<std::unique_ptr<Buffer>> m_Buffers;
+	Buffer* m_pCurrent;
+	uint64_t m_StreamOffset;
+	uint32_t m_MaxQueueDepth;
+	std::vector<uint32_t> m_Overruns;
+
+	std::mutex m_Mutex;
+	std::vector<Buffer*> m_Free;
+	bool m_IsStopping;
+
+	// hash thread, the buffers reach it in stream order
+	bool m_IsHashing;
+	std::thread m_HashThread;
+	std::condition_variable m_HashCond;
+	std::deque<Buffer*> m_HashQueue;
+	XXH64Hasher m_Hasher;
+	double m_HashSeconds;
+};
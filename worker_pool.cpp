@@ -0,0 +1,125 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t p_NumThreads)
+	: m_pFunc(NULL)
+	, m_NumTasks(0)
+	, m_NextTask(0)
+	, m_TasksDone(0)
+	, m_NumBusy(0)
+	, m_Generation(0)
+	, m_IsStopping(false)
+{
+	for (uint32_t i = 0; i < p_NumThreads; ++i) {
+		m_Threads.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+
+	m_WakeCond.notify_all();
+
+	for (size_t i = 0; i < m_Threads.size(); ++i) {
+		m_Threads[i].join();
+	}
+}
+
+uint32_t WorkerPool::s_GetDefaultNumThreads()
+{
+	const uint32_t numCores = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	return std::min<uint32_t>(7, std::max<uint32_t>(1, numCores / 8));
+}
+
+void WorkerPool::Run(uint32_t p_NumTasks, const std::function<void(uint32_t)>& p_Func)
+{
+	if (p_NumTasks == 0) {
+		return;
+	}
+
+	if (m_Threads.empty() || (p_NumTasks == 1)) {
+		for (uint32_t i = 0; i < p_NumTasks; ++i) {
+			p_Func(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_pFunc = &p_Func;
+		m_NumTasks = p_NumTasks;
+		m_NextTask = 0;
+		m_TasksDone = 0;
+		++m_Generation;
+	}
+
+	m_WakeCond.notify_all();
+
+	ExecuteTasks();
+
+	// workers still inside ExecuteTasks() must leave before the next Run() resets the counters
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_DoneCond.wait(lock, [this] { return (m_TasksDone == m_NumTasks) && (m_NumBusy == 0); });
+	m_pFunc = NULL;
+}
+
+void WorkerPool::WorkerLoop()
+{
+	uint64_t seenGeneration = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeCond.wait(lock, [this, seenGeneration] { return m_IsStopping || (m_Generation != seenGeneration); });
+			if (m_IsStopping) {
+				return;
+			}
+
+			seenGeneration = m_Generation;
+			++m_NumBusy;
+		}
+
+		ExecuteTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			--m_NumBusy;
+		}
+
+		m_DoneCond.notify_all();
+	}
+}
+
+void WorkerPool::ExecuteTasks()
+{
+	for (;;) {
+		uint32_t taskIdx = 0;
+		const std::function<void(uint32_t)>* pFunc = NULL;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if ((m_pFunc == NULL) || (m_NextTask >= m_NumTasks)) {
+				return;
+			}
+
+			taskIdx = m_NextTask++;
+			pFunc = m_pFunc;
+		}
+
+		(*pFunc)(taskIdx);
+
+		bool isLast = false;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			isLast = (++m_TasksDone == m_NumTasks);
+		}
+
+		if (isLast) {
+			m_DoneCond.notify_all();
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool used to split per-frame pixel work into row bands.
+// The calling thread takes part in the work, Run() returns once every task is done.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(uint32_t p_NumThreads);
+	~WorkerPool();
+
+	uint32_t GetNumThreads() const
+	{
+		return static_cast<uint32_t>(m_Threads.size());
+	}
+
+	void Run(uint32_t p_NumTasks, const std::function<void(uint32_t)>& p_Func);
+
+	// worker count for a plugin side pool, leaves most of the cores to x265
+	static uint32_t s_GetDefaultNumThreads();
+
+private:
+	WorkerPool(const WorkerPool& p_Other);
+	WorkerPool& operator=(const WorkerPool& p_Other);
+
+	void WorkerLoop();
+	void ExecuteTasks();
+
+private:
+	std::vector<std::thread> m_Threads;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCond;
+	std::condition_variable m_DoneCond;
+	const std::function<void(uint32_t)>* m_pFunc;
+	uint32_t m_NumTasks;
+	uint32_t m_NextTask;
+	uint32_t m_TasksDone;
+	uint32_t m_NumBusy;
+	uint64_t m_Generation;
+	bool m_IsStopping;
+};
@@ -7,25 +7,125 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <filesystem>
+#include <random>
+#include <thread>
 
 #include "x265.h"
 
+#include "hevc_config.h"
+#include "mp4_container.h"
+#include "pixel_convert.h"
+#include "xxhash64.h"
+
 const uint8_t X265Encoder::s_UUID[] = { 0x6a, 0x88, 0xe8, 0x41, 0xd8, 0xe4, 0x41, 0x4b, 0x87, 0x9e, 0xa4, 0x80, 0xfc, 0x90, 0xda, 0xb5 };
+const uint8_t X265Encoder::s_UUIDMain10[] = { 0x4e, 0x4f, 0xce, 0xc3, 0x76, 0x04, 0x41, 0x77, 0xb5, 0xe3, 0xe3, 0x27, 0x97, 0x4f, 0xc5, 0xdf };
+const uint8_t X265Encoder::s_UUIDMain422_10[] = { 0x27, 0x35, 0xb3, 0xd1, 0x1c, 0x84, 0x4d, 0x4a, 0x99, 0x8f, 0xcb, 0xa7, 0x32, 0xd5, 0x48, 0xb6 };
+const uint8_t X265Encoder::s_UUIDMain444[] = { 0x99, 0x13, 0xf7, 0xe5, 0x8f, 0xe4, 0x4a, 0x98, 0xbf, 0xd4, 0x72, 0xa0, 0xf7, 0xac, 0x15, 0x9d };
+
+// high bit depth samples arrive MSB aligned in 16-bit containers (P010), the pictures are tagged with the 16-bit
+// container depth so x265 shifts them down to the internal depth, unpacked v210 is the exception and is handed
+// over as 10-bit LSB aligned samples
+static const X265CodecDesc s_Codecs[] = {
+	{ X265Encoder::s_UUID, "X265 Main", "main", 8, 8, 2, 2, clrUYVY },
+	{ X265Encoder::s_UUIDMain10, "X265 Main10", "main10", 10, 16, 2, 2, clrV210 },
+	{ X265Encoder::s_UUIDMain422_10, "X265 Main 4:2:2 10", "main422-10", 10, 16, 2, 1, clrV210 },
+	{ X265Encoder::s_UUIDMain444, "X265 Main 4:4:4", "main444-8", 8, 8, 1, 1, clrUnknown },
+};
+
+static int s_GetCodecCSP(const X265CodecDesc* p_pCodec)
+{
+	if (p_pCodec->hSubsampling == 1) {
+		return X265_CSP_I444;
+	}
+
+	return (p_pCodec->vSubsampling == 1) ? X265_CSP_I422 : X265_CSP_I420;
+}
+
+// where the 2-pass stat files live, the output folder is often network storage
+enum StatsLocation
+{
+	statsLocal = 0, // temp folder of the machine
+	statsMemory = 1, // tmpfs, the temp folder where there is none
+	statsFolder = 2,
+	statsOutput = 3,
+};
+
+static bool s_IsPackedColorModel(uint32_t p_ColorModel)
+{
+	return (p_ColorModel == clrUYVY) || (p_ColorModel == clrV210);
+}
+
+static bool s_IsRGBColorModel(uint32_t p_ColorModel)
+{
+	return (p_ColorModel == clrRGB) || (p_ColorModel == clrRGBA);
+}
+
+static bool s_GetINT16(HostBufferRef* p_pBuff, const char* p_pKey, int16_t& p_Val)
+{
+	PropertyType propType = propTypeNull;
+	const void* pVal = NULL;
+	int numVals = 0;
+	if ((p_pBuff->GetProperty(p_pKey, &propType, &pVal, &numVals) != errNone) || (propType != propTypeInt16) || (numVals < 1)) {
+		return false;
+	}
+
+	p_Val = *static_cast<const int16_t*>(pVal);
+	return true;
+}
+
+// IRAP pictures (BLA, IDR, CRA) are the sync samples, an I picture coded as a plain trailing picture
+// may be followed by pictures referencing the previous GOP
+static bool s_IsRandomAccessPoint(const x265_nal* p_pNals, uint32_t p_NumNals)
+{
+	for (uint32_t i = 0; i < p_NumNals; ++i) {
+		if ((p_pNals[i].type >= NAL_UNIT_CODED_SLICE_BLA_W_LP) && (p_pNals[i].type <= NAL_UNIT_CODED_SLICE_CRA)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// opening frames that pick the stats cache candidates, the stat encode stops once they matched an entry
+static const size_t s_StatsCachePrefixFrames = 16;
+
+static const char* s_GetColorModelName(uint32_t p_ColorModel)
+{
+	switch (p_ColorModel) {
+	case clrYUVp:
+		return "planar";
+	case clrNV12:
+		return "nv12";
+	case clrUYVY:
+		return "uyvy";
+	case clrV210:
+		return "v210";
+	case clrRGB:
+		return "rgb";
+	case clrRGBA:
+		return "rgba";
+	default:
+		return "unknown";
+	}
+}
 
 class UISettingsController
 {
 public:
-	UISettingsController()
+	explicit UISettingsController(const X265CodecDesc* p_pCodec)
+		: m_pCodec(p_pCodec)
 	{
 		InitDefaults();
 	}
 
-	explicit UISettingsController(const HostCodecConfigCommon& p_CommonProps)
+	UISettingsController(const HostCodecConfigCommon& p_CommonProps, const X265CodecDesc* p_pCodec)
 		: m_CommonProps(p_CommonProps)
+		, m_pCodec(p_pCodec)
 	{
 		InitDefaults();
 	}
@@ -39,7 +139,7 @@ public:
 		uint8_t val8 = 0;
 		p_pValues->GetUINT8("x265_reset", val8);
 		if (val8 != 0) {
-			*this = UISettingsController();
+			*this = UISettingsController(m_pCodec);
 			return;
 		}
 
@@ -47,10 +147,27 @@ public:
 		p_pValues->GetINT32("x265_tune", m_Tune);
 		p_pValues->GetINT32("x265_profile", m_Profile);
 		p_pValues->GetINT32("x265_num_passes", m_NumPasses);
+		p_pValues->GetUINT8("x265_fast_first_pass", m_FastFirstPass);
+		p_pValues->GetINT32("x265_analysis_reuse", m_AnalysisReuse);
+		p_pValues->GetINT32("x265_stats_location", m_StatsLocation);
+		p_pValues->GetString("x265_stats_folder", m_StatsFolder);
+		p_pValues->GetUINT8("x265_frame_cache", m_FrameCache);
+		p_pValues->GetINT32("x265_frame_cache_budget", m_FrameCacheBudget);
+		p_pValues->GetUINT8("x265_stats_cache", m_StatsCache);
+		p_pValues->GetINT32("x265_stats_cache_size", m_StatsCacheSize);
 		p_pValues->GetINT32("x265_q_mode", m_QualityMode);
 		p_pValues->GetINT32("x265_qp", m_QP);
 		p_pValues->GetINT32("x265_bitrate", m_BitRate);
 		p_pValues->GetString("x265_enc_markers", m_MarkerColor);
+		p_pValues->GetUINT8("x265_mp4_faststart", m_MP4FastStart);
+		p_pValues->GetINT32("x265_mp4_layout", m_MP4Layout);
+		p_pValues->GetINT32("x265_mp4_frag_dur", m_MP4FragmentDuration);
+		p_pValues->GetUINT8("x265_hevc_stream", m_HEVCStream);
+		p_pValues->GetUINT8("x265_hevc_direct", m_HEVCDirect);
+		p_pValues->GetString("x265_hevc_copies", m_HEVCCopies);
+		p_pValues->GetUINT8("x265_gop_index", m_GOPIndex);
+		p_pValues->GetUINT8("x265_proxy", m_Proxy);
+		p_pValues->GetUINT8("x265_hash", m_Hash);
 	}
 
 	StatusCode Render(HostListRef* p_pSettingsList)
@@ -94,9 +211,26 @@ private:
 		m_Tune = -1;
 		m_Profile = 0;
 		m_NumPasses = 1;
+		m_FastFirstPass = 0;
+		m_AnalysisReuse = 0;
+		m_StatsLocation = statsLocal;
+		m_StatsFolder.clear();
+		m_FrameCache = 0;
+		m_FrameCacheBudget = 200;
+		m_StatsCache = 0;
+		m_StatsCacheSize = 8;
 		m_QualityMode = X265_RC_CRF;
 		m_QP = 28;
 		m_BitRate = 8000;
+		m_MP4FastStart = 0;
+		m_MP4Layout = 0;
+		m_MP4FragmentDuration = 2;
+		m_HEVCStream = 0;
+		m_HEVCDirect = 0;
+		m_HEVCCopies.clear();
+		m_GOPIndex = 0;
+		m_Proxy = 0;
+		m_Hash = 0;
 	}
 
 	StatusCode RenderGeneral(HostListRef* p_pSettingsList)
@@ -122,6 +256,109 @@ private:
 			}
 		}
 
+		// the plugin MP4 container picks these values up from the codec properties
+		if (MP4Container::s_IsSelected(m_CommonProps.GetContainer())) {
+			{
+				HostUIConfigEntryRef item("x265_mp4_layout");
+
+				std::vector<std::string> textsVec;
+				std::vector<int> valuesVec;
+
+				textsVec.push_back("Standard");
+				valuesVec.push_back(0);
+				textsVec.push_back("Fragmented (CMAF)");
+				valuesVec.push_back(1);
+
+				item.MakeComboBox("MP4 Layout", textsVec, valuesVec, m_MP4Layout);
+				item.SetTriggersUpdate(true);
+				if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+					g_Log(logLevelError, "X265 Plugin :: Failed to populate MP4 layout UI entry");
+					return errFail;
+				}
+			}
+
+			{
+				HostUIConfigEntryRef item("x265_mp4_faststart");
+				item.MakeCheckBox("Fast Start", "Place the index in front of the media", m_MP4FastStart != 0);
+				item.SetHidden(IsFragmentedMP4());
+				if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+					g_Log(logLevelError, "X265 Plugin :: Failed to populate fast start UI entry");
+					return errFail;
+				}
+			}
+
+			{
+				HostUIConfigEntryRef item("x265_mp4_frag_dur");
+				item.MakeSlider("Fragment Duration", "sec", m_MP4FragmentDuration, 1, 10, 2);
+				item.SetHidden(!IsFragmentedMP4());
+				if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+					g_Log(logLevelError, "X265 Plugin :: Failed to populate fragment duration UI entry");
+					return errFail;
+				}
+			}
+		}
+
+		// a raw copy of the bitstream next to the export, written by the plugin
+		{
+			HostUIConfigEntryRef item("x265_hevc_stream");
+			item.MakeCheckBox("Elementary Stream", "Also write an Annex-B .hevc file", m_HEVCStream != 0);
+			item.SetTriggersUpdate(true);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate elementary stream UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_hevc_direct");
+			item.MakeCheckBox("Direct I/O", "Bypass the page cache for the .hevc file", m_HEVCDirect != 0);
+			item.SetHidden(m_HEVCStream == 0);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate direct I/O UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_hevc_copies");
+			item.MakeTextBox("Copies To", m_HEVCCopies, "folders or pipes, separated by ;");
+			item.SetHidden((m_HEVCStream == 0) && (m_Proxy == 0));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate copy destinations UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_gop_index");
+			item.MakeCheckBox("Frame Index", "Write .hevc.idx and .hevc.idx.json access unit indexes of the elementary stream", m_GOPIndex != 0);
+			item.SetHidden(m_HEVCStream == 0);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate frame index UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_proxy");
+			item.MakeCheckBox("Proxy", "Also encode a half resolution _proxy.hevc", m_Proxy != 0);
+			item.SetTriggersUpdate(true);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate proxy UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_hash");
+			item.MakeCheckBox("Checksum", "Write .xxh64 digests of the .hevc streams", m_Hash != 0);
+			item.SetHidden((m_HEVCStream == 0) && (m_Proxy == 0));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate checksum UI entry");
+				return errFail;
+			}
+		}
+
 		// Preset combobox
 		{
 			HostUIConfigEntryRef item("x265_enc_preset");
@@ -178,11 +415,9 @@ private:
 			std::vector<std::string> textsVec;
 			std::vector<int> valuesVec;
 
+			// the profile follows the registered codec entry, e.g. "X265 Main10" encodes main10
 			valuesVec.push_back(0);
-			textsVec.push_back("main");
-
-			// valuesVec.push_back(1);
-			// textsVec.push_back("main10");
+			textsVec.push_back(m_pCodec->pProfile);
 
 			item.MakeComboBox("Encoder Profile", textsVec, valuesVec, m_Profile);
 			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
@@ -225,6 +460,119 @@ private:
 			}
 		}
 
+		{
+			HostUIConfigEntryRef item("x265_fast_first_pass");
+			item.MakeCheckBox("Fast First Pass", "Analyse the first pass with a faster preset, analysis reuse is off", m_FastFirstPass != 0);
+			item.SetHidden(m_NumPasses < 2);
+			item.SetTriggersUpdate(true);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate fast first pass UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_analysis_reuse");
+
+			std::vector<std::string> textsVec;
+			std::vector<int> valuesVec;
+
+			// x265 reuse levels: 1 lookahead, 2-4 modes and references, 5-6 rect / amp partitions, 7-10 down to the CU splits
+			textsVec.push_back("Off");
+			valuesVec.push_back(0);
+			textsVec.push_back("Lookahead");
+			valuesVec.push_back(1);
+			textsVec.push_back("Modes");
+			valuesVec.push_back(4);
+			textsVec.push_back("Partitions");
+			valuesVec.push_back(6);
+			textsVec.push_back("Full");
+			valuesVec.push_back(10);
+
+			item.MakeComboBox("Reuse Analysis", textsVec, valuesVec, m_AnalysisReuse);
+			item.SetHidden((m_NumPasses < 2) || (m_FastFirstPass != 0));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate analysis reuse UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_stats_location");
+
+			std::vector<std::string> textsVec;
+			std::vector<int> valuesVec;
+
+			textsVec.push_back("Local Temp");
+			valuesVec.push_back(statsLocal);
+			textsVec.push_back("In Memory");
+			valuesVec.push_back(statsMemory);
+			textsVec.push_back("Folder");
+			valuesVec.push_back(statsFolder);
+			textsVec.push_back("Next To Output");
+			valuesVec.push_back(statsOutput);
+
+			item.MakeComboBox("Pass Stats", textsVec, valuesVec, m_StatsLocation);
+			item.SetTriggersUpdate(true);
+			item.SetHidden(m_NumPasses < 2);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate stats location UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_stats_folder");
+			item.MakeTextBox("Stats Folder", m_StatsFolder, "local scratch folder");
+			item.SetHidden((m_NumPasses < 2) || (m_StatsLocation != statsFolder));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate stats folder UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_frame_cache");
+			item.MakeCheckBox("Frame Cache", "Spool the first pass frames next to the stats, the final pass needs no second render", m_FrameCache != 0);
+			item.SetTriggersUpdate(true);
+			item.SetHidden(m_NumPasses < 2);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate frame cache UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_frame_cache_budget");
+			item.MakeSlider("Cache Budget", "GB", m_FrameCacheBudget, 1, 4096, 200);
+			item.SetHidden((m_NumPasses < 2) || (m_FrameCache == 0));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate frame cache budget UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_stats_cache");
+			item.MakeCheckBox("Stats Cache", "Keep the first pass and reuse it when the timeline is unchanged", m_StatsCache != 0);
+			item.SetTriggersUpdate(true);
+			item.SetHidden(m_NumPasses < 2);
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate stats cache UI entry");
+				return errFail;
+			}
+		}
+
+		{
+			HostUIConfigEntryRef item("x265_stats_cache_size");
+			item.MakeSlider("Stats Cache Size", "GB", m_StatsCacheSize, 1, 256, 8);
+			item.SetHidden((m_NumPasses < 2) || (m_StatsCache == 0));
+			if (!item.IsSuccess() || !p_pSettingsList->Append(&item)) {
+				g_Log(logLevelError, "X265 Plugin :: Failed to populate stats cache size UI entry");
+				return errFail;
+			}
+		}
+
 		if (m_NumPasses < 2) {
 			HostUIConfigEntryRef item("x265_q_mode");
 
@@ -290,6 +638,54 @@ public:
 		return x265_preset_names[m_EncPreset];
 	}
 
+	bool IsFastFirstPass() const
+	{
+		return (m_NumPasses > 1) && (m_FastFirstPass != 0);
+	}
+
+	// x265 analysis reuse level shared by the two passes, 0 when the final pass analyses on its own.
+	// Off with a fast first pass, x265 rejects analysis saved with other references than the loading pass.
+	int32_t GetAnalysisReuseLevel() const
+	{
+		return ((m_NumPasses > 1) && !IsFastFirstPass()) ? std::max<int32_t>(0, std::min<int32_t>(10, m_AnalysisReuse)) : 0;
+	}
+
+	int32_t GetStatsLocation() const
+	{
+		return m_StatsLocation;
+	}
+
+	const std::string& GetStatsFolder() const
+	{
+		return m_StatsFolder;
+	}
+
+	bool IsCachingFrames() const
+	{
+		return (m_NumPasses > 1) && (m_FrameCache != 0);
+	}
+
+	uint64_t GetFrameCacheBudget() const
+	{
+		return static_cast<uint64_t>(std::max<int32_t>(1, m_FrameCacheBudget)) << 30;
+	}
+
+	bool IsCachingStats() const
+	{
+		return (m_NumPasses > 1) && (m_StatsCache != 0);
+	}
+
+	uint64_t GetStatsCacheSize() const
+	{
+		return static_cast<uint64_t>(std::max<int32_t>(1, m_StatsCacheSize)) << 30;
+	}
+
+	// the first pass analyses with the preset two steps faster than the final one
+	const char* GetFirstPassPreset() const
+	{
+		return x265_preset_names[std::max<int32_t>(0, m_EncPreset - 2)];
+	}
+
 	const char* GetTune() const
 	{
 
@@ -302,7 +698,7 @@ public:
 
 	const char* GetProfile() const
 	{
-		return x265_profile_names[m_Profile];
+		return m_pCodec->pProfile;
 	}
 
 	int32_t GetQualityMode() const
@@ -322,7 +718,7 @@ public:
 
 	int32_t GetBitDepth() const
 	{
-		return m_Profile == 0 ? 8 : 10;
+		return m_pCodec->bitDepth;
 	}
 
 	const std::string& GetMarkerColor() const
@@ -330,24 +726,105 @@ public:
 		return m_MarkerColor;
 	}
 
+	bool IsFragmentedMP4() const
+	{
+		return (m_MP4Layout == 1) && MP4Container::s_IsSelected(m_CommonProps.GetContainer());
+	}
+
+	int32_t GetFragmentDuration() const
+	{
+		return std::max<int32_t>(1, m_MP4FragmentDuration);
+	}
+
+	bool IsWritingStream() const
+	{
+		return (m_HEVCStream != 0);
+	}
+
+	bool IsStreamDirect() const
+	{
+		return (m_HEVCDirect != 0);
+	}
+
+	// extra destinations of the plugin written streams, a folder gets a file of the same name
+	std::vector<std::string> GetCopyDestinations() const
+	{
+		std::vector<std::string> destinations;
+		std::stringstream copies(m_HEVCCopies);
+		std::string destination;
+		while (std::getline(copies, destination, ';')) {
+			const size_t first = destination.find_first_not_of(" \t");
+			if (first != std::string::npos) {
+				destinations.push_back(destination.substr(first, destination.find_last_not_of(" \t") - first + 1));
+			}
+		}
+
+		return destinations;
+	}
+
+	// the index offsets address the .hevc file, there is no index without it
+	bool IsWritingIndex() const
+	{
+		return (m_HEVCStream != 0) && (m_GOPIndex != 0);
+	}
+
+	bool IsEncodingProxy() const
+	{
+		return (m_Proxy != 0);
+	}
+
+	bool IsHashingStreams() const
+	{
+		return (m_Hash != 0);
+	}
+
 private:
 	HostCodecConfigCommon m_CommonProps;
+	const X265CodecDesc* m_pCodec;
 	std::string m_MarkerColor;
 	int32_t m_EncPreset;
 	int32_t m_Tune;
 	int32_t m_Profile;
 	int32_t m_NumPasses;
+	uint8_t m_FastFirstPass;
+	int32_t m_AnalysisReuse;
+	int32_t m_StatsLocation;
+	std::string m_StatsFolder;
+	uint8_t m_FrameCache;
+	int32_t m_FrameCacheBudget; // GB
+	uint8_t m_StatsCache;
+	int32_t m_StatsCacheSize; // GB
 	int32_t m_QualityMode;
 	int32_t m_QP;
 	int32_t m_BitRate;
+	uint8_t m_MP4FastStart;
+	int32_t m_MP4Layout;
+	int32_t m_MP4FragmentDuration;
+	uint8_t m_HEVCStream;
+	uint8_t m_HEVCDirect;
+	std::string m_HEVCCopies;
+	uint8_t m_GOPIndex;
+	uint8_t m_Proxy;
+	uint8_t m_Hash;
 };
 
-StatusCode X265Encoder::s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
+const X265CodecDesc* X265Encoder::s_FindCodec(const uint8_t* p_pUUID)
+{
+	for (const X265CodecDesc& codec : s_Codecs) {
+		if (memcmp(p_pUUID, codec.pUUID, 16) == 0) {
+			return &codec;
+		}
+	}
+
+	return NULL;
+}
+
+StatusCode X265Encoder::s_GetEncoderSettings(const X265CodecDesc* p_pCodec, HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
 {
 	HostCodecConfigCommon commonProps;
 	commonProps.Load(p_pValues);
 
-	UISettingsController settings(commonProps);
+	UISettingsController settings(commonProps, p_pCodec);
 	settings.Load(p_pValues);
 
 	return settings.Render(p_pSettingsList);
@@ -360,18 +837,36 @@ StatusCode X265Encoder::s_RegisterCodecs(HostListRef* p_pList)
 
 	g_Log(logLevelInfo, "%s :: x265_ver_str = %s, x265_max_bit_depth = %d", logMessagePrefix, x265_version_str, x265_max_bit_depth);
 
+	for (const X265CodecDesc& codec : s_Codecs) {
+
+		// a single bit depth x265 build (or a multilib one lacking this depth) can't serve the entry
+		if (x265_api_get(codec.bitDepth) == NULL) {
+			g_Log(logLevelInfo, "%s :: %s skipped, x265 has no %u-bit support", logMessagePrefix, codec.pGroup, codec.bitDepth);
+			continue;
+		}
+
+		StatusCode err = s_RegisterCodec(codec, p_pList);
+		if (err != errNone) {
+			return err;
+		}
+	}
+
+	return errNone;
+}
+
+StatusCode X265Encoder::s_RegisterCodec(const X265CodecDesc& p_Codec, HostListRef* p_pList)
+{
 	HostPropertyCollectionRef codecInfo;
 	if (!codecInfo.IsValid()) {
 		return errAlloc;
 	}
 
-	codecInfo.SetProperty(pIOPropUUID, propTypeUInt8, X265Encoder::s_UUID, 16);
+	codecInfo.SetProperty(pIOPropUUID, propTypeUInt8, p_Codec.pUUID, 16);
 
 	const char* pCodecName = "Auto";
 	codecInfo.SetProperty(pIOPropName, propTypeString, pCodecName, static_cast<int>(strlen(pCodecName)));
 
-	const char* pCodecGroup = "X265 Main";
-	codecInfo.SetProperty(pIOPropGroup, propTypeString, pCodecGroup, static_cast<int>(strlen(pCodecGroup)));
+	codecInfo.SetProperty(pIOPropGroup, propTypeString, p_Codec.pGroup, static_cast<int>(strlen(p_Codec.pGroup)));
 
 	uint32_t vFourCC = 'hvc1';
 	codecInfo.SetProperty(pIOPropFourCC, propTypeUInt32, &vFourCC, 1);
@@ -382,8 +877,23 @@ StatusCode X265Encoder::s_RegisterCodecs(HostListRef* p_pList)
 	uint32_t vDirection = dirEncode;
 	codecInfo.SetProperty(pIOPropCodecDirection, propTypeUInt32, &vDirection, 1);
 
-	uint32_t vColorModel = clrNV12;
-	codecInfo.SetProperty(pIOPropColorModel, propTypeUInt32, &vColorModel, 1);
+	// planar is preferred since it goes to x265 without a copy, 4:2:0 entries keep NV12 as the fallback,
+	// packed 4:2:2 comes next so capture / intermediate formats reach the plugin without a host side conversion
+	std::vector<uint32_t> colorModelVec;
+	colorModelVec.push_back(clrYUVp);
+	if (s_GetCodecCSP(&p_Codec) == X265_CSP_I420) {
+		colorModelVec.push_back(clrNV12);
+	}
+	if (p_Codec.packedColorModel != clrUnknown) {
+		colorModelVec.push_back(p_Codec.packedColorModel);
+	}
+	// RGB timelines can skip the host conversion, the plugin runs the matrix and the chroma subsampling
+	colorModelVec.push_back(clrRGBA);
+	colorModelVec.push_back(clrRGB);
+	codecInfo.SetProperty(pIOPropColorModel, propTypeUInt32, colorModelVec.data(), static_cast<int>(colorModelVec.size()));
+
+	codecInfo.SetProperty(pIOPropHSubsampling, propTypeUInt8, &p_Codec.hSubsampling, 1);
+	codecInfo.SetProperty(pIOPropVSubsampling, propTypeUInt8, &p_Codec.vSubsampling, 1);
 
 	// Optionally enable both Data Ranges, Video will be default for "Auto" thus "0" value goes first
 	std::vector<uint8_t> dataRangeVec;
@@ -391,10 +901,10 @@ StatusCode X265Encoder::s_RegisterCodecs(HostListRef* p_pList)
 	dataRangeVec.push_back(1);
 	codecInfo.SetProperty(pIOPropDataRange, propTypeUInt8, dataRangeVec.data(), static_cast<int>(dataRangeVec.size()));
 
-	uint32_t vBitDepth = 8;
+	uint32_t vBitDepth = p_Codec.bitDepth;
 	codecInfo.SetProperty(pIOPropBitDepth, propTypeUInt32, &vBitDepth, 1);
 
-	vBitDepth = 8;
+	vBitDepth = p_Codec.bitsPerSample;
 	codecInfo.SetProperty(pIOPropBitsPerSample, propTypeUInt32, &vBitDepth, 1);
 
 	const uint32_t temp = 0;
@@ -406,6 +916,7 @@ StatusCode X265Encoder::s_RegisterCodecs(HostListRef* p_pList)
 	std::vector<std::string> containerVec;
 	containerVec.push_back("mp4");
 	containerVec.push_back("mov");
+	containerVec.push_back(MP4Container::s_GetUUIDString());
 	std::string valStrings;
 	for (size_t i = 0; i < containerVec.size(); ++i) {
 		valStrings.append(containerVec[i]);
@@ -423,10 +934,41 @@ StatusCode X265Encoder::s_RegisterCodecs(HostListRef* p_pList)
 	return errNone;
 }
 
-X265Encoder::X265Encoder()
-	: m_pContext(NULL)
+X265Encoder::X265Encoder(const X265CodecDesc* p_pCodec)
+	: m_pCodec(p_pCodec)
+	, m_pAPI(NULL)
+	, m_pContext(NULL)
 	, m_pParam(NULL)
 	, m_ColorModel(-1)
+	, m_InputColorModel(clrNV12)
+	, m_FieldOrder(0)
+	, m_ColorPrimaries(2)
+	, m_TransferCharacteristics(2)
+	, m_PlaneAllocsAtOpen(0)
+	, m_ConvertNanos(0)
+	, m_ConvertMaxNanos(0)
+	, m_ConvertBytes(0)
+	, m_ConvertCycles(0)
+	, m_LastDTS(0)
+	, m_HasLastDTS(false)
+	, m_OutputHostCalls(0)
+	, m_OutputBatches(0)
+	, m_OutputPackets(0)
+	, m_OutputBytes(0)
+	, m_OutputCopyBytes(0)
+	, m_OutputCopies(0)
+	, m_IsStreamFailed(false)
+	, m_NumStreamOverruns(0)
+	, m_IsIndexFailed(false)
+	, m_ProxyNanos(0)
+	, m_IsFrameCacheFailed(false)
+	, m_FrameCacheBitDepth(0)
+	, m_StatsPrefixKey(0)
+	, m_IsCheckingStats(false)
+	, m_IsStatsFromCache(false)
+	, m_IsStatsCacheBypassed(false)
+	, m_FrameHashNanos(0)
+	, m_FirstPassSeconds(0)
 	, m_IsMultiPass(false)
 	, m_FramesSubmitted(0)
 	, m_FramesWritten(0)
@@ -437,27 +979,106 @@ X265Encoder::X265Encoder()
 
 X265Encoder::~X265Encoder()
 {
+	m_pStreamWriter.reset();
+	m_pIndexWriter.reset();
+
+	// the proxy shares the x265 api, it has to be gone before cleanup()
+	m_pProxy.reset();
+	m_pFrameCache.reset();
+
 	if (m_pParam != NULL) {
-		x265_param_free(m_pParam);
+		m_pAPI->param_free(m_pParam);
 		m_pParam = NULL;
 	}
 
 	if (m_pContext != NULL) {
-		x265_encoder_close(m_pContext);
+		m_pAPI->encoder_close(m_pContext);
 		m_pContext = NULL;
-		x265_cleanup();
+		m_pAPI->cleanup();
+	}
+
+	// 2-pass encoding uses stat files and leaves them behind, a cancelled or failed export as well
+	if (m_IsMultiPass) {
+		RemoveStatFiles();
+	}
+
+}
+
+void X265Encoder::SetupStatFiles(const std::string& p_OutputPath)
+{
+	const std::filesystem::path outputPath(p_OutputPath);
+	std::filesystem::path folder;
+	std::error_code err;
+	switch (m_pSettings->GetStatsLocation()) {
+	case statsMemory:
+		if (std::filesystem::is_directory("/dev/shm", err)) {
+			folder = "/dev/shm";
+			break;
+		}
+		g_Log(logLevelInfo, "X265 Plugin :: DoOpen :: no tmpfs, the stats go to the temp folder");
+		folder = std::filesystem::temp_directory_path(err);
+		break;
+	case statsFolder:
+		folder = m_pSettings->GetStatsFolder();
+		break;
+	case statsOutput:
+		folder = outputPath.parent_path();
+		break;
+	default:
+		folder = std::filesystem::temp_directory_path(err);
+		break;
 	}
 
-	// 2-pass encoding uses stat files and leaves them behind, remove the two files
+	if (folder.empty() || !std::filesystem::is_directory(folder, err)) {
+		g_Log(logLevelError, "X265 Plugin :: DoOpen :: stats folder '%s' is not available, using the output folder", folder.string().c_str());
+		folder = outputPath.parent_path();
+	}
+
+	// jobs of the same name run side by side on one machine, the random part keeps their stats apart
+	std::random_device random;
+	char token[20];
+	snprintf(token, sizeof(token), ".%08x%08x", static_cast<uint32_t>(random()), static_cast<uint32_t>(random()));
+
+	m_sStatFileName = (folder / outputPath.filename()).string();
+	m_sStatFileName.append(token);
+	m_sStatFileName.append(".pass");
+	m_sAnalysisFileName = m_sStatFileName + ".analysis";
+
+	// the frame spool is as big as the timeline, it goes to disk scratch even when the stats are in memory
+	if (m_pSettings->IsCachingFrames()) {
+		std::filesystem::path spoolFolder = (m_pSettings->GetStatsLocation() == statsFolder) ? folder : std::filesystem::temp_directory_path(err);
+		if (spoolFolder.empty() || !std::filesystem::is_directory(spoolFolder, err) || FrameCache::IsMemoryBacked(spoolFolder.string())) {
+			spoolFolder = outputPath.parent_path();
+		}
 
-	if (m_IsMultiPass && (m_PassesDone >= 2)) {
-		std::string m_sStatCUTreeFN = m_sStatFileName;
-		m_sStatCUTreeFN.append(".cutree");
+		if (FrameCache::IsMemoryBacked(spoolFolder.string())) {
+			g_Log(logLevelError, "X265 Plugin :: DoOpen :: no disk scratch for the frame cache, the final pass is rendered again");
+			m_sFrameCachePath.clear();
+		} else {
+			m_sFrameCachePath = (spoolFolder / outputPath.filename()).string();
+			m_sFrameCachePath.append(token);
+			m_sFrameCachePath.append(".frames");
+		}
+	}
 
-		std::filesystem::remove(m_sStatFileName);
-		std::filesystem::remove(m_sStatCUTreeFN);
+	// the cache outlives the export, it sits in the stats folder under a name of its own
+	if (m_pSettings->IsCachingStats()) {
+		m_pStatsCache.reset(new StatsCache((folder / "x265-stats-cache").string(), m_pSettings->GetStatsCacheSize()));
 	}
+}
 
+void X265Encoder::RemoveStatFiles()
+{
+	// x265 writes <name>.temp and renames it when the pass closes, either one can be left over
+	const char* const suffixes[] = { "", ".temp", ".cutree", ".cutree.temp" };
+	std::error_code err;
+	for (const char* pSuffix : suffixes) {
+		std::filesystem::remove(m_sStatFileName + pSuffix, err);
+	}
+	std::filesystem::remove(m_sAnalysisFileName, err);
+	if (!m_sFrameCachePath.empty()) {
+		std::filesystem::remove(m_sFrameCachePath, err);
+	}
 }
 
 StatusCode X265Encoder::DoInit(HostPropertyCollectionRef* p_pProps)
@@ -487,62 +1108,118 @@ StatusCode X265Encoder::DoOpen(HostBufferRef* p_pBuff)
 
 	assert(!path.empty());
 
-	m_sStatFileName = path;
-	m_sStatFileName.append(".pass");
-
-	m_pSettings.reset(new UISettingsController(m_CommonProps));
+	m_pSettings.reset(new UISettingsController(m_CommonProps, m_pCodec));
 	m_pSettings->Load(p_pBuff);
 
+	m_pAPI = x265_api_get(m_pCodec->bitDepth);
+	if (m_pAPI == NULL) {
+		g_Log(logLevelError, "%s :: x265 has no %u-bit support", logMessagePrefix, m_pCodec->bitDepth);
+		return errUnsupported;
+	}
+
 	uint8_t isMultiPass = 0;
 	if (m_pSettings->GetNumPasses() == 2) {
 		m_IsMultiPass = true;
 		isMultiPass = 1;
+
+		SetupStatFiles(path);
+		g_Log(logLevelInfo, "%s :: pass stats = %s", logMessagePrefix, m_sStatFileName.c_str());
+		if (m_pStatsCache) {
+			g_Log(logLevelInfo, "%s :: stats cache = %s", logMessagePrefix, m_pStatsCache->GetFolder().c_str());
+		}
 	}
 
-	uint8_t vBitDepth = m_pSettings->GetBitDepth();
-	p_pBuff->SetProperty(pIOPropBitDepth, propTypeUInt32, &vBitDepth, 1);
-	vBitDepth = m_pSettings->GetBitDepth();
-	p_pBuff->SetProperty(pIOPropBitsPerSample, propTypeUInt32, &vBitDepth, 1);
+	// the host reports the color model it settled on, planar input has to match the codec subsampling
+	uint32_t colorModel = (s_GetCodecCSP(m_pCodec) == X265_CSP_I420) ? clrNV12 : clrYUVp;
+	uint8_t hSampling = m_pCodec->hSubsampling;
+	uint8_t vSampling = m_pCodec->vSubsampling;
+	p_pBuff->GetUINT32(pIOPropColorModel, colorModel);
+	p_pBuff->GetUINT8(pIOPropHSubsampling, hSampling);
+	p_pBuff->GetUINT8(pIOPropVSubsampling, vSampling);
+
+	if ((colorModel == clrYUVp) && (hSampling == m_pCodec->hSubsampling) && (vSampling == m_pCodec->vSubsampling)) {
+		m_InputColorModel = clrYUVp;
+	} else if ((colorModel == clrNV12) && (s_GetCodecCSP(m_pCodec) == X265_CSP_I420)) {
+		m_InputColorModel = clrNV12;
+	} else if ((colorModel != clrUnknown) && (colorModel == m_pCodec->packedColorModel)) {
+		m_InputColorModel = colorModel;
+	} else if (s_IsRGBColorModel(colorModel)) {
+		m_InputColorModel = colorModel;
+	} else {
+		g_Log(logLevelError, "%s :: unsupported color model %u (%u:%u)", logMessagePrefix, colorModel, hSampling, vSampling);
+		return errUnsupported;
+	}
 
-	g_Log(logLevelInfo, "%s :: bitDepth = %d", logMessagePrefix, m_pSettings->GetBitDepth());
+	g_Log(logLevelInfo, "%s :: colorModel = %s", logMessagePrefix, s_GetColorModelName(m_InputColorModel));
 
-	StatusCode sts = p_pBuff->SetProperty(pIOPropMultiPass, propTypeUInt8, &isMultiPass, 1);
-	if (sts != errNone) {
-		return sts;
+	// RGB input is converted with the matrix of the timeline primaries, BT.2020 (9) or BT.709 for anything else
+	s_GetINT16(p_pBuff, pIOPropColorPrimaries, m_ColorPrimaries);
+	s_GetINT16(p_pBuff, pIOTransferCharacteristics, m_TransferCharacteristics);
+	if (s_IsRGBColorModel(m_InputColorModel)) {
+		const RGBMatrix matrix = (m_ColorPrimaries == 9) ? rgbMatrixBT2020 : rgbMatrixBT709;
+		g_InitRGBConversion(matrix, (m_InputColorModel == clrRGBA) ? 4 : 3, m_pCodec->bitsPerSample, m_CommonProps.IsFullRange(), &m_RGBConversion);
+		g_Log(logLevelInfo, "%s :: rgb matrix = %s", logMessagePrefix, (matrix == rgbMatrixBT2020) ? "bt2020" : "bt709");
 	}
 
-	// this one is strictly for the header
+	// interlaced frames are coded as separate fields, 4:2:0 chroma rows alternate between the fields as well
+	m_FieldOrder = m_CommonProps.GetFieldOrder();
+	if (m_FieldOrder > 2) {
+		g_Log(logLevelError, "%s :: unsupported field order %u", logMessagePrefix, m_FieldOrder);
+		return errUnsupported;
+	}
+
+	if (IsInterlaced() && ((m_CommonProps.GetHeight() % (2 * m_pCodec->vSubsampling)) != 0)) {
+		g_Log(logLevelError, "%s :: interlaced height %u is not a multiple of %u", logMessagePrefix, m_CommonProps.GetHeight(), 2 * m_pCodec->vSubsampling);
+		return errInvalidParam;
+	}
+
+	g_Log(logLevelInfo, "%s :: fieldOrder = %s", logMessagePrefix, (m_FieldOrder == 0) ? "progressive" : ((m_FieldOrder == 1) ? "top first" : "bottom first"));
+
+	uint32_t vBitDepth = m_pCodec->bitDepth;
+	p_pBuff->SetProperty(pIOPropBitDepth, propTypeUInt32, &vBitDepth, 1);
+	vBitDepth = m_pCodec->bitsPerSample;
+	p_pBuff->SetProperty(pIOPropBitsPerSample, propTypeUInt32, &vBitDepth, 1);
+
+	g_Log(logLevelInfo, "%s :: bitDepth = %d", logMessagePrefix, m_pSettings->GetBitDepth());
+	g_Log(logLevelInfo, "%s :: chroma conversion simd = %s", logMessagePrefix, g_GetSIMDLevelName(g_GetSIMDLevel()));
+
+	StatusCode sts = p_pBuff->SetProperty(pIOPropMultiPass, propTypeUInt8, &isMultiPass, 1);
+	if (sts != errNone) {
+		return sts;
+	}
+
+	// this one is strictly for the header
 
 	SetupContext(true);
+	if (m_Error != errNone) {
+		return m_Error;
+	}
 
 	x265_nal* pNals;
 	uint32_t numNals = 0;
-	int hdrBytes = x265_encoder_headers(m_pContext, &pNals, &numNals);
+	int hdrBytes = m_pAPI->encoder_headers(m_pContext, &pNals, &numNals);
 
 	if (hdrBytes > 0) {
 
-		std::vector<uint8_t> cookie;
-
+		// with bAnnexB off every payload starts with a 4 byte length instead of a start code
+		std::vector<HEVCNalRef> paramSets;
+		m_StreamHeaders.clear();
 		for (uint32_t i = 0; i < numNals; i++) {
-
-			if (pNals[i].type == NAL_UNIT_PREFIX_SEI) {
-				continue;
+			if (pNals[i].sizeBytes > 4) {
+				paramSets.push_back(HEVCNalRef { pNals[i].payload + 4, pNals[i].sizeBytes - 4 });
 			}
-
-			pNals[i].payload[0] = 0;
-			pNals[i].payload[1] = 0;
-			pNals[i].payload[2] = 0;
-			pNals[i].payload[3] = 1;
-
-			cookie.insert(cookie.end(), pNals[i].payload, pNals[i].payload + pNals[i].sizeBytes);
-
+			m_StreamHeaders.insert(m_StreamHeaders.end(), pNals[i].payload, pNals[i].payload + pNals[i].sizeBytes);
 		}
 
-		if (!cookie.empty()) {
-			p_pBuff->SetProperty(pIOPropMagicCookie, propTypeUInt8, &cookie[0], static_cast<int>(cookie.size()));
-			uint32_t fourCC = 0;
-			p_pBuff->SetProperty(pIOPropMagicCookieType, propTypeUInt32, &fourCC, 1);
+		std::vector<uint8_t> cookie;
+		if (!g_BuildHEVCDecoderConfig(paramSets, &cookie)) {
+			g_Log(logLevelError, "%s :: failed to build the hvcC record from the x265 headers", logMessagePrefix);
+			return errFail;
 		}
+
+		p_pBuff->SetProperty(pIOPropMagicCookie, propTypeUInt8, &cookie[0], static_cast<int>(cookie.size()));
+		uint32_t fourCC = 'hvcC';
+		p_pBuff->SetProperty(pIOPropMagicCookieType, propTypeUInt32, &fourCC, 1);
 	}
 
 	uint32_t vBFrames = m_pParam->bframes;
@@ -568,24 +1245,41 @@ void X265Encoder::SetupContext(bool p_IsFinalPass)
 	g_Log(logLevelInfo, "%s :: p_isFinalPass = %d", logMessagePrefix, p_IsFinalPass);
 
 	if (m_pParam != NULL) {
-		x265_param_free(m_pParam);
+		m_pAPI->param_free(m_pParam);
 		m_pParam = NULL;
 	}
 
+	m_pProxy.reset();
+
 	if (m_pContext != NULL) {
-		x265_encoder_close(m_pContext);
-		x265_cleanup();
+		m_pAPI->encoder_close(m_pContext);
+		m_pAPI->cleanup();
 		m_pContext = NULL;
 	}
 
 	m_FramesSubmitted = 0;
 	m_FramesWritten = 0;
-	m_pParam = x265_param_alloc();
+	m_ConvertNanos = 0;
+	m_ConvertMaxNanos = 0;
+	m_ConvertBytes = 0;
+	m_ConvertCycles = 0;
+	m_PendingFrames.clear();
+	m_LastDTS = 0;
+	m_HasLastDTS = false;
+	m_OutputHostCalls = 0;
+	m_OutputBatches = 0;
+	m_OutputPackets = 0;
+	m_OutputBytes = 0;
+	m_OutputCopyBytes = 0;
+	m_OutputCopies = 0;
+	m_ProxyNanos = 0;
+	m_PassStartTime = std::chrono::steady_clock::now();
+	m_pParam = m_pAPI->param_alloc();
 
 	const char* pProfile = m_pSettings->GetProfile();
-	m_ColorModel = X265_CSP_I420;
+	m_ColorModel = s_GetCodecCSP(m_pCodec);
 
-	if (x265_param_default_preset(m_pParam, m_pSettings->GetEncPreset(), m_pSettings->GetTune()) != 0) {
+	if (m_pAPI->param_default_preset(m_pParam, m_pSettings->GetEncPreset(), m_pSettings->GetTune()) != 0) {
 		g_Log(logLevelInfo, "%s :: setting x265 param default presets failed", logMessagePrefix);
 		m_Error = errFail;
 		return;
@@ -594,10 +1288,36 @@ void X265Encoder::SetupContext(bool p_IsFinalPass)
 	m_pParam->internalCsp = m_ColorModel;
 	m_pParam->sourceWidth = m_CommonProps.GetWidth();
 	m_pParam->sourceHeight = m_CommonProps.GetHeight();
-	m_pParam->sourceBitDepth = m_pSettings->GetBitDepth();
+	m_pParam->sourceBitDepth = m_pCodec->bitsPerSample;
 	m_pParam->fpsNum = m_CommonProps.GetFrameRateNum();
 	m_pParam->fpsDenom = m_CommonProps.GetFrameRateDen();
 	m_pParam->vui.bEnableVideoFullRangeFlag = m_CommonProps.IsFullRange();
+	// packets carry 4 byte NAL lengths (hvcC lengthSizeMinusOne 3), the MP4 / MOV writers store them as is
+	m_pParam->bAnnexB = 0;
+
+	// field coding: every picture handed to x265 is one field at twice the frame rate
+	if (IsInterlaced()) {
+		m_pParam->interlaceMode = m_FieldOrder;
+		m_pParam->bField = 1;
+		m_pParam->sourceHeight = m_CommonProps.GetHeight() / 2;
+		m_pParam->fpsNum = m_CommonProps.GetFrameRateNum() * 2;
+	}
+	if (s_IsRGBColorModel(m_InputColorModel)) {
+		// the plugin picked the matrix, signal it so decoders invert the same one
+		m_pParam->vui.bEnableColorDescriptionPresentFlag = 1;
+		m_pParam->vui.colorPrimaries = (m_ColorPrimaries == 9) ? 9 : 1;
+		m_pParam->vui.matrixCoeffs = (m_ColorPrimaries == 9) ? 9 : 1;
+		m_pParam->vui.transferCharacteristics = m_TransferCharacteristics;
+	}
+	// fragmented MP4 starts every fragment on an IDR, a fixed closed GOP of one fragment duration
+	// keeps the fragments even, scene cuts inside a GOP become plain I pictures
+	if (m_pSettings->IsFragmentedMP4() && (m_pParam->fpsDenom > 0)) {
+		const int gopLength = std::max<int>(1, static_cast<int>(std::lround(static_cast<double>(m_pSettings->GetFragmentDuration()) * m_pParam->fpsNum / m_pParam->fpsDenom)));
+		m_pParam->bOpenGOP = 0;
+		m_pParam->keyframeMax = gopLength;
+		m_pParam->keyframeMin = gopLength;
+		g_Log(logLevelInfo, "%s :: fragmented mp4, closed gop of %d pictures", logMessagePrefix, gopLength);
+	}
 	m_pParam->rc.rateControlMode = m_pSettings->GetQualityMode();
 
 	if (!m_IsMultiPass && (m_pParam->rc.rateControlMode != X265_RC_ABR)) {
@@ -622,19 +1342,132 @@ void X265Encoder::SetupContext(bool p_IsFinalPass)
 		}
 
 		m_pParam->rc.statFileName = &m_sStatFileName[0];
+
+		if (!p_IsFinalPass && m_pSettings->IsFastFirstPass()) {
+			ApplyFastFirstPass();
+		}
+
+		// the stat pass saves its mode decisions and motion vectors, the final pass starts from them
+		const int32_t reuseLevel = m_pSettings->GetAnalysisReuseLevel();
+		if ((reuseLevel > 0) && !p_IsFinalPass) {
+			m_pParam->analysisSave = m_sAnalysisFileName.c_str();
+			m_pParam->analysisSaveReuseLevel = reuseLevel;
+			g_Log(logLevelInfo, "%s :: analysis save at reuse level %d", logMessagePrefix, reuseLevel);
+		} else if ((reuseLevel > 0) && (m_PassesDone > 0)) {
+			m_pParam->analysisLoad = m_sAnalysisFileName.c_str();
+			m_pParam->analysisLoadReuseLevel = reuseLevel;
+			g_Log(logLevelInfo, "%s :: analysis load at reuse level %d", logMessagePrefix, reuseLevel);
+		}
 	}
 
 	if (pProfile != NULL) {
-		if (x265_param_apply_profile(m_pParam, pProfile) != 0) {
+		if (m_pAPI->param_apply_profile(m_pParam, pProfile) != 0) {
 			m_Error = errFail;
 			return;
 		}
 	}
 
-	m_pContext = x265_encoder_open(m_pParam);
+	if (!SetupInputPlanes()) {
+		g_Log(logLevelError, "%s :: failed to allocate chroma planes", logMessagePrefix);
+		m_Error = errAlloc;
+		return;
+	}
+
+	// the proxy takes a quarter of the cores, the master pool is capped so the two do not oversubscribe.
+	// the header-only context that DoOpen sets up ahead of a first pass encodes nothing and gets neither
+	const bool isProxy = p_IsFinalPass && (!m_IsMultiPass || (m_PassesDone > 0)) && m_pSettings->IsEncodingProxy();
+	const uint32_t numCores = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	const uint32_t proxyThreads = std::max<uint32_t>(1, numCores / 4);
+	const uint32_t masterThreads = std::max<uint32_t>(1, numCores - proxyThreads);
+	if (isProxy) {
+		m_NumaPools = std::to_string(masterThreads);
+		m_pParam->numaPools = m_NumaPools.c_str();
+	}
+
+	m_pContext = m_pAPI->encoder_open(m_pParam);
 
 	m_Error = ((m_pContext != NULL) ? errNone : errFail);
 
+	if ((m_Error == errNone) && isProxy) {
+		std::filesystem::path proxyPath(m_CommonProps.GetPath());
+		proxyPath.replace_filename(proxyPath.stem().string() + "_proxy.hevc");
+
+		m_pProxy.reset(new ProxyEncoder());
+		if (m_pProxy->Open(m_pAPI, m_pParam, GetStreamPaths(proxyPath), proxyThreads, m_pSettings->IsHashingStreams())) {
+			g_Log(logLevelInfo, "%s :: proxy %ux%u, threads = %u + %u, %s", logMessagePrefix, m_pProxy->GetWidth(), m_pProxy->GetHeight(),
+				masterThreads, proxyThreads, proxyPath.string().c_str());
+		} else {
+			g_Log(logLevelError, "%s :: failed to set up the proxy encoder, the master is encoded alone", logMessagePrefix);
+			m_pProxy.reset();
+		}
+	}
+
+}
+
+bool X265Encoder::SetupInputPlanes()
+{
+	// planar input needs no scratch planes, NV12 needs the split chroma, packed and RGB input all three planes
+	const bool needsLuma = s_IsPackedColorModel(m_InputColorModel) || s_IsRGBColorModel(m_InputColorModel);
+	if ((m_InputColorModel != clrNV12) && !needsLuma) {
+		m_InputPlanes.Release();
+		m_PlaneAllocsAtOpen = m_InputPlanes.GetNumAllocs();
+		return true;
+	}
+
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t width = m_CommonProps.GetWidth();
+	const uint32_t height = m_CommonProps.GetHeight();
+	const uint32_t chromaWidth = width / m_pCodec->hSubsampling;
+	const uint32_t chromaHeight = height / m_pCodec->vSubsampling;
+
+	if (needsLuma) {
+		if (!m_InputPlanes.Reserve(0, width * pixelBytes, height)) {
+			return false;
+		}
+	}
+
+	if (!m_InputPlanes.Reserve(1, chromaWidth * pixelBytes, chromaHeight) || !m_InputPlanes.Reserve(2, chromaWidth * pixelBytes, chromaHeight)) {
+		return false;
+	}
+
+	m_PlaneAllocsAtOpen = m_InputPlanes.GetNumAllocs();
+
+	// above 1440p the conversion is worth spreading over row bands, x265 keeps the remaining cores
+	const uint64_t numPixels = static_cast<uint64_t>(width) * height;
+	if (!m_pConvertPool && (numPixels >= (2560 * 1440))) {
+		m_pConvertPool.reset(new WorkerPool(WorkerPool::s_GetDefaultNumThreads()));
+		g_Log(logLevelInfo, "X265 Plugin :: SetupInputPlanes :: conversion threads = %u", m_pConvertPool->GetNumThreads() + 1);
+	}
+
+	return true;
+}
+
+void X265Encoder::RunRowBands(uint32_t p_NumRows, const std::function<void(uint32_t p_StartRow, uint32_t p_EndRow)>& p_ConvertRows)
+{
+	// horizontal bands of at least 32 rows, one per conversion thread
+	uint32_t numBands = 1;
+	if (m_pConvertPool) {
+		numBands = std::max<uint32_t>(1, std::min<uint32_t>(m_pConvertPool->GetNumThreads() + 1, p_NumRows / 32));
+	}
+
+	if (numBands == 1) {
+		p_ConvertRows(0, p_NumRows);
+		return;
+	}
+
+	// the closure only holds a reference so std::function keeps it inline, no per-frame heap allocation
+	struct BandJob
+	{
+		const std::function<void(uint32_t, uint32_t)>* pConvertRows;
+		uint32_t numRows;
+		uint32_t numBands;
+	} job = { &p_ConvertRows, p_NumRows, numBands };
+
+	m_pConvertPool->Run(numBands, [&job](uint32_t p_BandIdx) {
+		const uint32_t startRow = static_cast<uint32_t>((static_cast<uint64_t>(job.numRows) * p_BandIdx) / job.numBands);
+		const uint32_t endRow = static_cast<uint32_t>((static_cast<uint64_t>(job.numRows) * (p_BandIdx + 1)) / job.numBands);
+		(*job.pConvertRows)(startRow, endRow);
+	});
 }
 
 StatusCode X265Encoder::DoProcess(HostBufferRef* p_pBuff)
@@ -646,11 +1479,10 @@ StatusCode X265Encoder::DoProcess(HostBufferRef* p_pBuff)
 	}
 
 	x265_picture outPic;
-	x265_picture_init(m_pParam, &outPic);
+	m_pAPI->picture_init(m_pParam, &outPic);
 
 	x265_nal* pNals = 0;
 	uint32_t numNals = 0;
-	int bytes = 0;
 	int encoderRet = 0;
 	int64_t pts = -1;
 
@@ -658,9 +1490,41 @@ StatusCode X265Encoder::DoProcess(HostBufferRef* p_pBuff)
 		return errMoreData;
 	}
 
+	// the stat encode of a first pass answered from the stats cache is closed already
+	if ((m_pContext == NULL) && (p_pBuff == NULL || !p_pBuff->IsValid())) {
+		return errMoreData;
+	}
+
 	if ((p_pBuff == NULL || !p_pBuff->IsValid())) {
 
-		encoderRet = x265_encoder_encode(m_pContext, &pNals, &numNals, 0, &outPic);
+		// drain everything x265 still holds and hand it to the host as one batch
+		StatusCode sts = errMoreData;
+		while (true) {
+			encoderRet = m_pAPI->encoder_encode(m_pContext, &pNals, &numNals, 0, &outPic);
+			if (encoderRet <= 0) {
+				if (encoderRet < 0) {
+					sts = errFail;
+				}
+				break;
+			}
+
+			const StatusCode encodedSts = ProcessEncoded(encoderRet, pNals, numNals, outPic);
+			if ((encodedSts != errNone) && (encodedSts != errMoreData)) {
+				sts = encodedSts;
+				break;
+			}
+
+			if (encodedSts == errNone) {
+				sts = errNone;
+			}
+		}
+
+		// the encoder is empty, frames still waiting for a field have no partner left
+		if ((encoderRet == 0) && !m_PendingFrames.empty()) {
+			sts = QueuePendingFrames(true);
+		}
+
+		return DeliverPackets(sts);
 
 	} else {
 
@@ -677,100 +1541,1243 @@ StatusCode X265Encoder::DoProcess(HostBufferRef* p_pBuff)
 			return errUnsupported;
 		}
 
-		uint32_t width = 0;
-		uint32_t height = 0;
-
-		if (!p_pBuff->GetUINT32(pIOPropWidth, width) || !p_pBuff->GetUINT32(pIOPropHeight, height)) {
-			g_Log(logLevelError, "X265 Plugin :: DoProcess :: Width/Height not set when encoding the frame");
-			return errNoParam;
-		}
-
 		if (!p_pBuff->GetINT64(pIOPropPTS, pts)) {
 			g_Log(logLevelError, "X265 Plugin :: DoProcess :: PTS not set when encoding the frame");
+			p_pBuff->UnlockBuffer();
 			return errNoParam;
 		}
 
-		x265_picture inPic;
-		x265_picture_init(m_pParam, &inPic);
+		uint32_t colorModel = m_InputColorModel;
+		p_pBuff->GetUINT32(pIOPropColorModel, colorModel);
 
-		// NV12 > I420
+		InputFrameLayout layout;
+		StatusCode sts = LoadFrameLayout(p_pBuff, colorModel, &layout);
+		if (sts != errNone) {
+			p_pBuff->UnlockBuffer();
+			return sts;
+		}
+
+		x265_picture inPic;
+		m_pAPI->picture_init(m_pParam, &inPic);
+		// picture_init leaves the internal depth, x265 reads the samples at the depth of the picture
+		inPic.bitDepth = m_pCodec->bitsPerSample;
 
 		uint8_t* pSrc = reinterpret_cast<uint8_t*>(const_cast<char*>(pBuf));
 
-		int iPixelBytes = m_pSettings->GetBitDepth() > 8 ? 2 : 1;
+		if (colorModel == clrYUVp) {
+			sts = SetupPlanarPicture(pSrc, bufSize, layout, &inPic);
+		} else if (s_IsPackedColorModel(colorModel)) {
+			sts = SetupPackedPicture(pSrc, bufSize, layout, &inPic);
+		} else if (s_IsRGBColorModel(colorModel)) {
+			sts = SetupRGBPicture(pSrc, bufSize, layout, &inPic);
+		} else {
+			sts = SetupNV12Picture(pSrc, bufSize, layout, &inPic);
+		}
+
+		if (sts != errNone) {
+			p_pBuff->UnlockBuffer();
+			return sts;
+		}
 
-		uint32_t ySize = width * height;
+		if (m_pProxy) {
+			EncodeProxy(pSrc, layout, inPic, pts);
+		}
 
-		std::vector<uint8_t> uPlane;
-		std::vector<uint8_t> vPlane;
+		if (m_IsMultiPass && (m_PassesDone == 0) && m_pSettings->IsCachingFrames()) {
+			CacheFrame(inPic, pts);
+		}
 
-		uint8_t* uvSrc = pSrc;
-		uvSrc += ySize;
+		// once the opening frames matched a cached first pass, the rest of the pass is only hashed
+		if (m_pStatsCache && m_IsMultiPass && (m_PassesDone == 0) && CheckStatsCache(inPic)) {
+			p_pBuff->UnlockBuffer();
+			return errMoreData;
+		}
 
-		uPlane.reserve((ySize / 4) * iPixelBytes);
-		vPlane.reserve((ySize / 4) * iPixelBytes);
+		sts = EncodePicture(inPic, pts);
 
-		for (uint32_t i = 0; i < (ySize / 4) * 2; i += (2 * iPixelBytes)) {
+		p_pBuff->UnlockBuffer();
 
-			uPlane.push_back(uvSrc[0]);
-			vPlane.push_back(uvSrc[1]);
+		return DeliverPackets(sts);
+	}
+}
 
-			uvSrc += (2 * iPixelBytes);
-		}
+StatusCode X265Encoder::EncodePicture(const x265_picture& p_Pic, int64_t p_PTS)
+{
+	x265_picture outPic;
+	m_pAPI->picture_init(m_pParam, &outPic);
+
+	x265_nal* pNals = 0;
+	uint32_t numNals = 0;
+	int encoderRet = 0;
 
-		inPic.pts = pts;
-		inPic.planes[0] = pSrc;
-		inPic.planes[1] = uPlane.data();
-		inPic.planes[2] = vPlane.data();
-		inPic.stride[0] = width * iPixelBytes;
-		inPic.stride[1] = (width / 2) * iPixelBytes;
-		inPic.stride[2] = (width / 2) * iPixelBytes;
+	if (!IsInterlaced()) {
+		x265_picture inPic = p_Pic;
+		inPic.pts = p_PTS;
 
-		encoderRet = x265_encoder_encode(m_pContext, &pNals, &numNals, &inPic, &outPic);
+		encoderRet = m_pAPI->encoder_encode(m_pContext, &pNals, &numNals, &inPic, &outPic);
 
-		p_pBuff->UnlockBuffer();
+		m_FramesSubmitted++;
 
+		return ProcessEncoded(encoderRet, pNals, numNals, outPic);
+	}
+
+	// fields are addressed in place: every other row of each plane, starting at row 0 for the top field.
+	// Field PTS run at twice the frame rate, 2 * pts for the first field and 2 * pts + 1 for the second.
+	StatusCode sts = errMoreData;
+	for (int fieldIdx = 0; fieldIdx < 2; ++fieldIdx) {
+		const bool isTop = ((m_FieldOrder == 1) == (fieldIdx == 0));
+
+		x265_picture fieldPic = p_Pic;
+		for (int i = 0; i < 3; ++i) {
+			fieldPic.planes[i] = static_cast<uint8_t*>(p_Pic.planes[i]) + (isTop ? 0 : p_Pic.stride[i]);
+			fieldPic.stride[i] = p_Pic.stride[i] * 2;
+		}
+		fieldPic.pts = p_PTS * 2 + fieldIdx;
+		fieldPic.fieldNum = isTop ? 1 : 2;
+
+		encoderRet = m_pAPI->encoder_encode(m_pContext, &pNals, &numNals, &fieldPic, &outPic);
 		m_FramesSubmitted++;
 
+		const StatusCode fieldSts = ProcessEncoded(encoderRet, pNals, numNals, outPic);
+		if ((fieldSts != errNone) && (fieldSts != errMoreData)) {
+			return fieldSts;
+		}
+
+		if (fieldSts == errNone) {
+			sts = errNone;
+		}
 	}
 
-	if (encoderRet == 0) {
+	return sts;
+}
+
+StatusCode X265Encoder::ProcessEncoded(int p_EncoderRet, x265_nal* p_pNals, uint32_t p_NumNals, const x265_picture& p_OutPic)
+{
+	if (p_EncoderRet == 0) {
 		return errMoreData;
-	} else if (encoderRet < 0) {
+	} else if (p_EncoderRet < 0) {
 		return errFail;
 	} else if (m_IsMultiPass && (m_PassesDone == 0)) {
 		return errNone;
 	}
 
-	// this should only write if encodeRet == 1
+	const bool isKeyFrame = s_IsRandomAccessPoint(p_pNals, p_NumNals);
 
-	bytes = pNals[0].sizeBytes;
+	if (!IsInterlaced()) {
+		m_FramesWritten++;
+		return QueuePacket(NULL, p_pNals, p_NumNals, p_OutPic.pts, p_OutPic.dts, p_OutPic.sliceType, isKeyFrame);
+	}
+
+	// the two fields of a frame go out as one packet in frame time. With B-frames the fields of a frame are not
+	// always next to each other in decode order, so they are collected by frame number and frames leave in the
+	// decode order of their first field once both fields are in.
+	const int64_t frameNum = p_OutPic.pts >> 1;
+	std::deque<PendingFrame>::iterator it = m_PendingFrames.begin();
+	while ((it != m_PendingFrames.end()) && (it->frameNum != frameNum)) {
+		++it;
+	}
+
+	if (it == m_PendingFrames.end()) {
+		PendingFrame frame;
+		frame.frameNum = frameNum;
+		frame.firstFieldDTS = p_OutPic.dts;
+		frame.sliceType = p_OutPic.sliceType;
+		frame.isKeyFrame = isKeyFrame;
+		frame.numFields = 0;
+		m_PendingFrames.push_back(frame);
+		it = m_PendingFrames.end() - 1;
+	}
+
+	// the field completing the oldest frame goes out straight from the x265 NAL memory
+	if ((it == m_PendingFrames.begin()) && (it->numFields == 1)) {
+		m_FramesWritten += 2;
+		const StatusCode sts = QueuePacket(&it->data, p_pNals, p_NumNals, frameNum, GetFrameDTS(it->firstFieldDTS), it->sliceType, it->isKeyFrame);
+		m_PendingFrames.pop_front();
+		if (sts != errNone) {
+			return sts;
+		}
+
+		const StatusCode pendingSts = QueuePendingFrames(false);
+		return (pendingSts == errMoreData) ? errNone : pendingSts;
+	}
+
+	// x265 reuses its NAL memory on the next call, a field that has to wait is kept aside
+	for (uint32_t i = 0; i < p_NumNals; ++i) {
+		it->data.insert(it->data.end(), p_pNals[i].payload, p_pNals[i].payload + p_pNals[i].sizeBytes);
+		m_OutputCopyBytes += p_pNals[i].sizeBytes;
+		++m_OutputCopies;
+	}
+	++it->numFields;
+
+	return errMoreData;
+}
+
+StatusCode X265Encoder::QueuePendingFrames(bool p_IsDraining)
+{
+	// complete frames at the front go out, when draining a frame missing a field goes out with the one it has
+	StatusCode sts = errMoreData;
+	while (!m_PendingFrames.empty() && (p_IsDraining || (m_PendingFrames.front().numFields == 2))) {
+		const PendingFrame& frame = m_PendingFrames.front();
+		m_FramesWritten += frame.numFields;
+		sts = QueuePacket(&frame.data, NULL, 0, frame.frameNum, GetFrameDTS(frame.firstFieldDTS), frame.sliceType, frame.isKeyFrame);
+		m_PendingFrames.pop_front();
+		if (sts != errNone) {
+			return sts;
+		}
+	}
+
+	return sts;
+}
+
+int64_t X265Encoder::GetFrameDTS(int64_t p_FirstFieldDTS) const
+{
+	// field DTS halved to frame time, first fields of neighbouring frames can land on the same value
+	const int64_t dts = p_FirstFieldDTS >> 1;
+	return (m_HasLastDTS && (dts <= m_LastDTS)) ? (m_LastDTS + 1) : dts;
+}
+
+StatusCode X265Encoder::QueuePacket(const std::vector<uint8_t>* p_pPrefix, const x265_nal* p_pNals, uint32_t p_NumNals, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsKeyFrame)
+{
+	// an access unit is every NAL of the encode call (AUD, parameter sets, SEI, slices),
+	// gathered with one copy per NAL into a host buffer recycled from the pool
+	size_t packetSize = (p_pPrefix != NULL) ? p_pPrefix->size() : 0;
+	for (uint32_t i = 0; i < p_NumNals; ++i) {
+		packetSize += p_pNals[i].sizeBytes;
+	}
+
+	// the host muxer needs decode timestamps that strictly increase, a packet breaking that would corrupt the file
+	if (m_HasLastDTS && (p_DTS <= m_LastDTS)) {
+		g_Log(logLevelError, "X265 Plugin :: QueuePacket :: DTS %lld does not follow DTS %lld", static_cast<long long>(p_DTS), static_cast<long long>(m_LastDTS));
+		return errFail;
+	}
+	m_LastDTS = p_DTS;
+	m_HasLastDTS = true;
+
+	const uint64_t poolCallsBefore = m_OutputPool.GetNumHostCalls();
+	HostBufferPool::Buffer* pOut = m_OutputPool.Acquire(packetSize);
+	m_OutputHostCalls += m_OutputPool.GetNumHostCalls() - poolCallsBefore;
+	if (pOut == NULL) {
+		return errAlloc;
+	}
 
-	HostBufferRef outBuf(false);
-	if (!outBuf.IsValid() || !outBuf.Resize(bytes)) {
+	char* pOutData = NULL;
+	size_t outDataSize = 0;
+	m_OutputHostCalls += 2;
+	if (!pOut->pBuf->LockBuffer(&pOutData, &outDataSize)) {
 		return errAlloc;
 	}
 
-	char* pOutBuf = NULL;
-	size_t outBufSize = 0;
-	if (!outBuf.LockBuffer(&pOutBuf, &outBufSize)) {
+	if (outDataSize < packetSize) {
+		pOut->pBuf->UnlockBuffer();
 		return errAlloc;
 	}
 
-	memcpy(pOutBuf, pNals[0].payload, bytes);
+	uint8_t* pWrite = reinterpret_cast<uint8_t*>(pOutData);
+	if ((p_pPrefix != NULL) && !p_pPrefix->empty()) {
+		memcpy(pWrite, p_pPrefix->data(), p_pPrefix->size());
+		pWrite += p_pPrefix->size();
+		m_OutputCopyBytes += p_pPrefix->size();
+		++m_OutputCopies;
+	}
+
+	for (uint32_t i = 0; i < p_NumNals; ++i) {
+		memcpy(pWrite, p_pNals[i].payload, p_pNals[i].sizeBytes);
+		pWrite += p_pNals[i].sizeBytes;
+		m_OutputCopyBytes += p_pNals[i].sizeBytes;
+		++m_OutputCopies;
+	}
+
+	if (m_pSettings->IsWritingStream()) {
+		WriteStream(reinterpret_cast<const uint8_t*>(pOutData), packetSize);
+	}
+
+	if (m_pSettings->IsWritingIndex()) {
+		WriteIndex(reinterpret_cast<const uint8_t*>(pOutData), packetSize, p_PTS, p_DTS, p_SliceType, p_IsKeyFrame);
+	}
+
+	pOut->pBuf->UnlockBuffer();
+
+	// recycled buffers keep their properties, only the ones that differ from the last packet go to the host
+	const uint8_t isKeyFrame = p_IsKeyFrame ? 1 : 0;
+	if (!pOut->hasProps || (pOut->pts != p_PTS)) {
+		pOut->pBuf->SetProperty(pIOPropPTS, propTypeInt64, &p_PTS, 1);
+		++m_OutputHostCalls;
+	}
+	if (!pOut->hasProps || (pOut->dts != p_DTS)) {
+		pOut->pBuf->SetProperty(pIOPropDTS, propTypeInt64, &p_DTS, 1);
+		++m_OutputHostCalls;
+	}
+	if (!pOut->hasProps || (pOut->isKeyFrame != isKeyFrame)) {
+		pOut->pBuf->SetProperty(pIOPropIsKeyFrame, propTypeUInt8, &isKeyFrame, 1);
+		++m_OutputHostCalls;
+	}
+
+	pOut->hasProps = true;
+	pOut->pts = p_PTS;
+	pOut->dts = p_DTS;
+	pOut->isKeyFrame = isKeyFrame;
+
+	pOut->isQueued = true;
+	m_OutputQueue.push_back(pOut);
 
-	int64_t vPts = outPic.pts;
-	outBuf.SetProperty(pIOPropPTS, propTypeInt64, &vPts, 1);
+	++m_OutputPackets;
+	m_OutputBytes += packetSize;
 
-	int64_t vDts = outPic.dts;
-	outBuf.SetProperty(pIOPropDTS, propTypeInt64, &vDts, 1);
+	return errNone;
+}
 
-	uint8_t isKeyFrame = IS_X265_TYPE_I(outPic.sliceType) ? 1 : 0;
-	outBuf.SetProperty(pIOPropIsKeyFrame, propTypeUInt8, &isKeyFrame, 1);
+std::vector<std::string> X265Encoder::GetStreamPaths(const std::filesystem::path& p_Path) const
+{
+	std::vector<std::string> paths(1, p_Path.string());
+	for (const std::string& destination : m_pSettings->GetCopyDestinations()) {
+		std::filesystem::path copyPath(destination);
+		std::error_code err;
+		if (std::filesystem::is_directory(copyPath, err)) {
+			copyPath /= p_Path.filename();
+		}
+		paths.push_back(copyPath.string());
+	}
 
-	m_FramesWritten++;
+	return paths;
+}
 
-	return m_pCallback->SendOutput(&outBuf);
+std::filesystem::path X265Encoder::GetStreamPath() const
+{
+	std::filesystem::path streamPath(m_CommonProps.GetPath());
+	streamPath.replace_extension(".hevc");
+	if (streamPath == std::filesystem::path(m_CommonProps.GetPath())) {
+		streamPath += ".hevc";
+	}
+
+	return streamPath;
+}
+
+void X265Encoder::WriteStream(const uint8_t* p_pData, size_t p_Size)
+{
+	if (m_IsStreamFailed) {
+		return;
+	}
+
+	// opened with the first packet of the final pass, the analysis pass has nothing to write
+	if (!m_pStreamWriter) {
+		const std::filesystem::path streamPath(GetStreamPath());
+
+		// every destination is written from the same buffers, there is no copy pass after the render
+		m_pStreamWriter.reset(new StreamWriter());
+		if (!m_pStreamWriter->Open(GetStreamPaths(streamPath), m_pSettings->IsStreamDirect(), m_pSettings->IsHashingStreams()) || !m_pStreamWriter->WriteNals(m_StreamHeaders.data(), m_StreamHeaders.size())) {
+			g_Log(logLevelError, "X265 Plugin :: WriteStream :: failed to open %s or one of its copies", streamPath.string().c_str());
+			m_IsStreamFailed = true;
+			m_pStreamWriter.reset();
+			return;
+		}
+
+		for (uint32_t i = 0; i < m_pStreamWriter->GetNumDestinations(); ++i) {
+			g_Log(logLevelInfo, "X265 Plugin :: WriteStream :: %s, %s%s", m_pStreamWriter->GetPath(i).c_str(),
+				m_pStreamWriter->IsPipe(i) ? "pipe" : (m_pStreamWriter->IsUsingIOURing(i) ? "io_uring" : "sync writes"), m_pStreamWriter->IsDirect(i) ? ", direct" : "");
+		}
+	}
+
+	// a failed stream does not fail the export, the container output is still good
+	if (!m_pStreamWriter->WriteNals(p_pData, p_Size)) {
+		g_Log(logLevelError, "X265 Plugin :: WriteStream :: write failed, the elementary stream is incomplete");
+		m_IsStreamFailed = true;
+	}
+
+	// a reader or mount that stopped taking data is dropped, the other copies go on
+	for (; m_NumStreamOverruns < m_pStreamWriter->GetNumOverruns(); ++m_NumStreamOverruns) {
+		g_Log(logLevelError, "X265 Plugin :: WriteStream :: %s fell %u MB behind and is dropped", m_pStreamWriter->GetPath(m_pStreamWriter->GetOverrun(m_NumStreamOverruns)).c_str(),
+			static_cast<uint32_t>((StreamWriter::s_MaxQueuedBuffers * StreamWriter::s_BufferSize) >> 20));
+	}
+}
+
+void X265Encoder::CloseStream()
+{
+	if (!m_pStreamWriter) {
+		return;
+	}
+
+	m_pStreamWriter->Close();
+	for (uint32_t i = 0; i < m_pStreamWriter->GetNumDestinations(); ++i) {
+		const double writeSeconds = m_pStreamWriter->GetWriteSeconds(i);
+		const double megaBytes = m_pStreamWriter->GetBytesWritten(i) / (1024.0 * 1024.0);
+		const bool isOk = !m_pStreamWriter->HasFailed(i);
+		g_Log(isOk ? logLevelInfo : logLevelError, "X265 Plugin :: DoFlush :: elementary stream %s = %.1f MB, %.1f MB/s%s", m_pStreamWriter->GetPath(i).c_str(),
+			megaBytes, (writeSeconds > 0) ? (megaBytes / writeSeconds) : 0.0, isOk ? "" : (m_pStreamWriter->IsOverrun(i) ? ", dropped behind" : ", write failed"));
+	}
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: elementary stream max queue depth = %u, buffers = %u", m_pStreamWriter->GetMaxQueueDepth(), m_pStreamWriter->GetNumBuffers());
+	WriteDigests(*m_pStreamWriter, "elementary stream");
+
+	m_pStreamWriter.reset();
+	m_NumStreamOverruns = 0;
+}
+
+void X265Encoder::WriteDigests(const StreamWriter& p_Writer, const char* p_pName)
+{
+	if (!p_Writer.IsHashing()) {
+		return;
+	}
+
+	char digest[17];
+	snprintf(digest, sizeof(digest), "%016llx", static_cast<unsigned long long>(p_Writer.GetDigest()));
+
+	uint64_t numBytes = 0;
+	for (uint32_t i = 0; i < p_Writer.GetNumDestinations(); ++i) {
+		numBytes = std::max(numBytes, p_Writer.GetBytesWritten(i));
+	}
+	const double hashSeconds = p_Writer.GetHashSeconds();
+	const double megaBytes = numBytes / (1024.0 * 1024.0);
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: %s XXH64 = %s, hashed at %.1f MB/s", p_pName, digest, (hashSeconds > 0) ? (megaBytes / hashSeconds) : 0.0);
+
+	// xxhsum -H1 -c reads these, a pipe has no file to check and a failed copy has no valid one
+	for (uint32_t i = 0; i < p_Writer.GetNumDestinations(); ++i) {
+		if (p_Writer.IsPipe(i) || p_Writer.HasFailed(i)) {
+			continue;
+		}
+
+		const std::filesystem::path path(p_Writer.GetPath(i));
+		const std::string digestPath = path.string() + ".xxh64";
+		std::ofstream digestFile(digestPath, std::ios::out | std::ios::trunc);
+		digestFile << digest << "  " << path.filename().string() << "\n";
+		digestFile.close();
+		if (!digestFile) {
+			g_Log(logLevelError, "X265 Plugin :: DoFlush :: failed to write %s", digestPath.c_str());
+		}
+	}
+}
+
+void X265Encoder::WriteIndex(const uint8_t* p_pData, size_t p_Size, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsKeyFrame)
+{
+	if (m_IsIndexFailed) {
+		return;
+	}
+
+	if (!m_pIndexWriter) {
+		// named after the elementary stream its offsets point into
+		const std::string indexPath = GetStreamPath().string() + ".idx";
+
+		// interlaced packets carry a field pair, timestamps are in frames of the host rate either way
+		m_pIndexWriter.reset(new GOPIndexWriter());
+		if (!m_pIndexWriter->Open(indexPath, m_CommonProps.GetFrameRateNum(), m_CommonProps.GetFrameRateDen(), m_StreamHeaders.size())) {
+			g_Log(logLevelError, "X265 Plugin :: WriteIndex :: failed to open %s", indexPath.c_str());
+			m_IsIndexFailed = true;
+			m_pIndexWriter.reset();
+			return;
+		}
+	}
+
+	if (!m_pIndexWriter->Add(p_pData, p_Size, p_PTS, p_DTS, p_SliceType, p_IsKeyFrame)) {
+		g_Log(logLevelError, "X265 Plugin :: WriteIndex :: write failed, the index is incomplete");
+		m_IsIndexFailed = true;
+	}
+}
+
+void X265Encoder::CloseIndex()
+{
+	if (!m_pIndexWriter) {
+		return;
+	}
+
+	const bool isOk = m_pIndexWriter->Close();
+	g_Log(isOk ? logLevelInfo : logLevelError, "X265 Plugin :: DoFlush :: index = %llu access units, %llu random access points%s",
+		static_cast<unsigned long long>(m_pIndexWriter->GetNumRecords()), static_cast<unsigned long long>(m_pIndexWriter->GetNumRandomAccess()), isOk ? "" : ", write failed");
+
+	m_pIndexWriter.reset();
+}
+
+StatusCode X265Encoder::DeliverPackets(StatusCode p_Sts)
+{
+	// everything the encode calls of this DoProcess / DoFlush produced goes out in one run, in decode order
+	if (m_OutputQueue.empty()) {
+		return p_Sts;
+	}
+
+	StatusCode sts = errNone;
+	for (HostBufferPool::Buffer* pOut : m_OutputQueue) {
+		pOut->isQueued = false;
+		if (sts == errNone) {
+			sts = m_pCallback->SendOutput(pOut->pBuf.get());
+			++m_OutputHostCalls;
+		}
+	}
+
+	m_OutputQueue.clear();
+	++m_OutputBatches;
+
+	return (sts != errNone) ? sts : p_Sts;
+}
+
+StatusCode X265Encoder::LoadFrameLayout(HostBufferRef* p_pBuff, uint32_t p_ColorModel, InputFrameLayout* p_pLayout)
+{
+	memset(p_pLayout, 0, sizeof(InputFrameLayout));
+	p_pLayout->colorModel = p_ColorModel;
+
+	if ((s_IsPackedColorModel(p_ColorModel) && (p_ColorModel != m_pCodec->packedColorModel)) ||
+		(s_IsRGBColorModel(p_ColorModel) && (p_ColorModel != m_InputColorModel))) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: %s input is not supported by %s", s_GetColorModelName(p_ColorModel), m_pCodec->pGroup);
+		return errUnsupported;
+	}
+
+	if (!p_pBuff->GetUINT32(pIOPropWidth, p_pLayout->width) || !p_pBuff->GetUINT32(pIOPropHeight, p_pLayout->height)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Width/Height not set when encoding the frame");
+		return errNoParam;
+	}
+
+	const uint32_t pixelBytes = GetPixelBytes();
+	const bool isNV12 = (p_ColorModel == clrNV12);
+	const bool isPacked = s_IsPackedColorModel(p_ColorModel) || s_IsRGBColorModel(p_ColorModel);
+	const uint32_t chromaWidth = isNV12 ? p_pLayout->width : (p_pLayout->width / m_pCodec->hSubsampling);
+
+	// tightly packed planes unless the host reports the line pitch of each plane
+	if (p_ColorModel == clrV210) {
+		p_pLayout->strides[0] = static_cast<uint32_t>(g_GetV210Stride(p_pLayout->width));
+	} else if (p_ColorModel == clrUYVY) {
+		p_pLayout->strides[0] = p_pLayout->width * 2 * pixelBytes;
+	} else if (s_IsRGBColorModel(p_ColorModel)) {
+		p_pLayout->strides[0] = p_pLayout->width * ((p_ColorModel == clrRGBA) ? 4 : 3) * pixelBytes;
+	} else {
+		p_pLayout->strides[0] = p_pLayout->width * pixelBytes;
+		p_pLayout->strides[1] = chromaWidth * pixelBytes;
+		p_pLayout->strides[2] = isNV12 ? 0 : chromaWidth * pixelBytes;
+	}
+
+	PropertyType propType = propTypeNull;
+	const void* pVal = NULL;
+	int numVals = 0;
+	if (((p_pBuff->GetProperty(pIOPropStride, &propType, &pVal, &numVals) == errNone) ||
+		 (p_pBuff->GetProperty(pIOBufferStride, &propType, &pVal, &numVals) == errNone)) &&
+		(propType == propTypeUInt32) && (numVals > 0)) {
+		const uint32_t* pStrides = static_cast<const uint32_t*>(pVal);
+		const int numPlanes = isPacked ? 1 : (isNV12 ? 2 : 3);
+		for (int i = 0; i < std::min(numVals, numPlanes); ++i) {
+			if (pStrides[i] > 0) {
+				p_pLayout->strides[i] = pStrides[i];
+			}
+		}
+	}
+
+	p_pLayout->cropWidth = p_pLayout->width;
+	p_pLayout->cropHeight = p_pLayout->height;
+	p_pBuff->GetUINT32(pIOPropCropTopX, p_pLayout->cropX);
+	p_pBuff->GetUINT32(pIOPropCropTopY, p_pLayout->cropY);
+	p_pBuff->GetUINT32(pIOPropCropWidth, p_pLayout->cropWidth);
+	p_pBuff->GetUINT32(pIOPropCropHeight, p_pLayout->cropHeight);
+
+	if (((p_pLayout->cropX + p_pLayout->cropWidth) > p_pLayout->width) || ((p_pLayout->cropY + p_pLayout->cropHeight) > p_pLayout->height)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Crop %ux%u+%u+%u outside of the %ux%u frame",
+			p_pLayout->cropWidth, p_pLayout->cropHeight, p_pLayout->cropX, p_pLayout->cropY, p_pLayout->width, p_pLayout->height);
+		return errInvalidParam;
+	}
+
+	// chroma sited crops only, an odd offset would shift chroma against luma
+	if (((p_pLayout->cropX % m_pCodec->hSubsampling) != 0) || ((p_pLayout->cropY % m_pCodec->vSubsampling) != 0)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Crop offset %u,%u is not aligned to the chroma subsampling", p_pLayout->cropX, p_pLayout->cropY);
+		return errInvalidParam;
+	}
+
+	// v210 is only addressable in whole 6 pixel groups
+	if ((p_ColorModel == clrV210) && ((p_pLayout->cropX % 6) != 0)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Crop offset %u is not aligned to a v210 pixel group", p_pLayout->cropX);
+		return errInvalidParam;
+	}
+
+	if ((p_pLayout->cropWidth != m_CommonProps.GetWidth()) || (p_pLayout->cropHeight != m_CommonProps.GetHeight())) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Frame %ux%u does not match the encoder size %ux%u",
+			p_pLayout->cropWidth, p_pLayout->cropHeight, m_CommonProps.GetWidth(), m_CommonProps.GetHeight());
+		return errInvalidParam;
+	}
+
+	return errNone;
+}
+
+StatusCode X265Encoder::SetupNV12Picture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic)
+{
+	// NV12 / P010 > I420, luma is used in place and the chroma gets split into the pooled planes
+
+	const uint32_t pixelBytes = GetPixelBytes();
+
+	const size_t uvOffset = static_cast<size_t>(p_Layout.strides[0]) * p_Layout.height;
+	const size_t uvSize = static_cast<size_t>(p_Layout.strides[1]) * (p_Layout.height / 2);
+	const uint32_t chromaWidth = p_Layout.cropWidth / 2;
+	const uint32_t chromaHeight = p_Layout.cropHeight / 2;
+
+	// no-op unless the frame is larger than the geometry negotiated in DoOpen
+	if (!m_InputPlanes.Reserve(1, chromaWidth * pixelBytes, chromaHeight) || !m_InputPlanes.Reserve(2, chromaWidth * pixelBytes, chromaHeight)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Failed to allocate chroma planes");
+		return errAlloc;
+	}
+
+	if (p_SrcSize < (uvOffset + uvSize)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: NV12 buffer too small, %zu < %zu", p_SrcSize, uvOffset + uvSize);
+		return errFail;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	const uint64_t startCycles = g_ReadCycleCounter();
+
+	const uint8_t* uvSrc = p_pSrc + uvOffset + static_cast<size_t>(p_Layout.cropY / 2) * p_Layout.strides[1] + static_cast<size_t>(p_Layout.cropX) * pixelBytes;
+	const uint32_t uvStride = p_Layout.strides[1];
+
+	const uint32_t chromaStride = m_InputPlanes.GetStride(1);
+	uint8_t* pDstU = m_InputPlanes.GetPlane(1);
+	uint8_t* pDstV = m_InputPlanes.GetPlane(2);
+
+	struct RowJob
+	{
+		const uint8_t* pSrc;
+		uint8_t* pDstU;
+		uint8_t* pDstV;
+		uint32_t srcStride;
+		uint32_t dstStride;
+		uint32_t width;
+		uint32_t pixelBytes;
+	} job = { uvSrc, pDstU, pDstV, uvStride, chromaStride, chromaWidth, pixelBytes };
+
+	RunRowBands(chromaHeight, [&job](uint32_t p_StartRow, uint32_t p_EndRow) {
+		const uint8_t* pSrcRow = job.pSrc + static_cast<size_t>(p_StartRow) * job.srcStride;
+		uint8_t* pRowU = job.pDstU + static_cast<size_t>(p_StartRow) * job.dstStride;
+		uint8_t* pRowV = job.pDstV + static_cast<size_t>(p_StartRow) * job.dstStride;
+
+		for (uint32_t row = p_StartRow; row < p_EndRow; ++row) {
+
+			if (job.pixelBytes == 1) {
+				g_DeinterleaveUV8(pSrcRow, pRowU, pRowV, job.width);
+			} else {
+				g_DeinterleaveUV16(reinterpret_cast<const uint16_t*>(pSrcRow), reinterpret_cast<uint16_t*>(pRowU), reinterpret_cast<uint16_t*>(pRowV), job.width);
+			}
+
+			pSrcRow += job.srcStride;
+			pRowU += job.dstStride;
+			pRowV += job.dstStride;
+		}
+	});
+
+	const uint64_t convertNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+	m_ConvertNanos += convertNanos;
+	m_ConvertMaxNanos = std::max(m_ConvertMaxNanos, convertNanos);
+	m_ConvertCycles += g_ReadCycleCounter() - startCycles;
+	m_ConvertBytes += static_cast<uint64_t>(chromaWidth) * 2 * pixelBytes * chromaHeight;
+
+	p_pPic->planes[0] = p_pSrc + static_cast<size_t>(p_Layout.cropY) * p_Layout.strides[0] + static_cast<size_t>(p_Layout.cropX) * pixelBytes;
+	p_pPic->planes[1] = m_InputPlanes.GetPlane(1);
+	p_pPic->planes[2] = m_InputPlanes.GetPlane(2);
+	p_pPic->stride[0] = p_Layout.strides[0];
+	p_pPic->stride[1] = chromaStride;
+	p_pPic->stride[2] = m_InputPlanes.GetStride(2);
+
+	return errNone;
+}
+
+StatusCode X265Encoder::SetupPlanarPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic)
+{
+	// planar 4:2:0, 4:2:2 and 4:4:4 are handed to x265 straight from the locked host buffer without a copy,
+	// padded strides and crop offsets are passed through instead of repacking
+
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t hSub = m_pCodec->hSubsampling;
+	const uint32_t vSub = m_pCodec->vSubsampling;
+	const size_t ySize = static_cast<size_t>(p_Layout.strides[0]) * p_Layout.height;
+	const size_t uSize = static_cast<size_t>(p_Layout.strides[1]) * (p_Layout.height / vSub);
+	const size_t vSize = static_cast<size_t>(p_Layout.strides[2]) * (p_Layout.height / vSub);
+
+	if (p_SrcSize < (ySize + uSize + vSize)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Planar buffer too small, %zu < %zu", p_SrcSize, ySize + uSize + vSize);
+		return errFail;
+	}
+
+	const size_t chromaOffsetU = static_cast<size_t>(p_Layout.cropY / vSub) * p_Layout.strides[1] + static_cast<size_t>(p_Layout.cropX / hSub) * pixelBytes;
+	const size_t chromaOffsetV = static_cast<size_t>(p_Layout.cropY / vSub) * p_Layout.strides[2] + static_cast<size_t>(p_Layout.cropX / hSub) * pixelBytes;
+
+	p_pPic->planes[0] = p_pSrc + static_cast<size_t>(p_Layout.cropY) * p_Layout.strides[0] + static_cast<size_t>(p_Layout.cropX) * pixelBytes;
+	p_pPic->planes[1] = p_pSrc + ySize + chromaOffsetU;
+	p_pPic->planes[2] = p_pSrc + ySize + uSize + chromaOffsetV;
+	p_pPic->stride[0] = p_Layout.strides[0];
+	p_pPic->stride[1] = p_Layout.strides[1];
+	p_pPic->stride[2] = p_Layout.strides[2];
+
+	return errNone;
+}
+
+StatusCode X265Encoder::SetupPackedPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic)
+{
+	// UYVY / v210 > planar, all three planes are unpacked into the pool in one pass over the source,
+	// 4:2:0 entries average the chroma of each row pair in the same pass
+
+	const bool isV210 = (p_Layout.colorModel == clrV210);
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t vSub = m_pCodec->vSubsampling;
+	const uint32_t chromaWidth = p_Layout.cropWidth / 2;
+	const uint32_t chromaHeight = p_Layout.cropHeight / vSub;
+	const size_t frameSize = static_cast<size_t>(p_Layout.strides[0]) * p_Layout.height;
+
+	if (!m_InputPlanes.Reserve(0, p_Layout.cropWidth * pixelBytes, p_Layout.cropHeight) ||
+		!m_InputPlanes.Reserve(1, chromaWidth * pixelBytes, chromaHeight) || !m_InputPlanes.Reserve(2, chromaWidth * pixelBytes, chromaHeight)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Failed to allocate input planes");
+		return errAlloc;
+	}
+
+	if (p_SrcSize < frameSize) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Packed buffer too small, %zu < %zu", p_SrcSize, frameSize);
+		return errFail;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	const uint64_t startCycles = g_ReadCycleCounter();
+
+	const size_t cropOffset = isV210 ? ((p_Layout.cropX / 6) * 16) : (static_cast<size_t>(p_Layout.cropX) * 2 * pixelBytes);
+
+	// one job row is a chroma row, it covers vSub luma rows
+	struct RowJob
+	{
+		const uint8_t* pSrc;
+		uint8_t* pDst[3];
+		uint32_t srcStride;
+		uint32_t dstStride[3];
+		uint32_t width;
+		uint32_t vSub;
+		bool isInterlaced;
+		bool isV210;
+	} job = { p_pSrc + static_cast<size_t>(p_Layout.cropY) * p_Layout.strides[0] + cropOffset,
+			  { m_InputPlanes.GetPlane(0), m_InputPlanes.GetPlane(1), m_InputPlanes.GetPlane(2) },
+			  p_Layout.strides[0],
+			  { m_InputPlanes.GetStride(0), m_InputPlanes.GetStride(1), m_InputPlanes.GetStride(2) },
+			  p_Layout.cropWidth, vSub, IsInterlaced(), isV210 };
+
+	RunRowBands(chromaHeight, [&job](uint32_t p_StartRow, uint32_t p_EndRow) {
+		for (uint32_t row = p_StartRow; row < p_EndRow; ++row) {
+			// interlaced 4:2:0 chroma row r belongs to field r & 1 and averages two luma rows of that field
+			const size_t lumaRow = (job.vSub == 1) ? row : (job.isInterlaced ? (4 * static_cast<size_t>(row >> 1) + (row & 1)) : (2 * static_cast<size_t>(row)));
+			const size_t lumaStep = job.isInterlaced ? 2 : 1;
+
+			const uint8_t* pSrc0 = job.pSrc + lumaRow * job.srcStride;
+			const uint8_t* pSrc1 = (job.vSub == 2) ? (pSrc0 + lumaStep * job.srcStride) : NULL;
+			uint8_t* pY0 = job.pDst[0] + lumaRow * job.dstStride[0];
+			uint8_t* pY1 = (job.vSub == 2) ? (pY0 + lumaStep * job.dstStride[0]) : NULL;
+			uint8_t* pU = job.pDst[1] + static_cast<size_t>(row) * job.dstStride[1];
+			uint8_t* pV = job.pDst[2] + static_cast<size_t>(row) * job.dstStride[2];
+
+			if (job.isV210) {
+				g_UnpackV210(pSrc0, pSrc1, reinterpret_cast<uint16_t*>(pY0), reinterpret_cast<uint16_t*>(pY1),
+							 reinterpret_cast<uint16_t*>(pU), reinterpret_cast<uint16_t*>(pV), job.width);
+			} else {
+				g_UnpackUYVY(pSrc0, pSrc1, pY0, pY1, pU, pV, job.width);
+			}
+		}
+	});
+
+	const uint64_t convertNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+	m_ConvertNanos += convertNanos;
+	m_ConvertMaxNanos = std::max(m_ConvertMaxNanos, convertNanos);
+	m_ConvertCycles += g_ReadCycleCounter() - startCycles;
+	m_ConvertBytes += static_cast<uint64_t>(p_Layout.cropWidth) * pixelBytes * p_Layout.cropHeight + static_cast<uint64_t>(chromaWidth) * 2 * pixelBytes * chromaHeight;
+
+	for (int i = 0; i < 3; ++i) {
+		p_pPic->planes[i] = m_InputPlanes.GetPlane(i);
+		p_pPic->stride[i] = m_InputPlanes.GetStride(i);
+	}
+
+	// v210 unpacks to 10-bit values in the low bits rather than the MSB aligned container of the other inputs
+	if (isV210) {
+		p_pPic->bitDepth = 10;
+	}
+
+	return errNone;
+}
+
+StatusCode X265Encoder::SetupRGBPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic)
+{
+	// RGB(A) > YCbCr with the matrix chosen in DoOpen, the chroma of each 2x2 (4:2:0), 2x1 (4:2:2) or single
+	// pixel (4:4:4) is taken from the averaged RGB so the subsampling needs no second pass
+
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t hSub = m_pCodec->hSubsampling;
+	const uint32_t vSub = m_pCodec->vSubsampling;
+	const uint32_t chromaWidth = p_Layout.cropWidth / hSub;
+	const uint32_t chromaHeight = p_Layout.cropHeight / vSub;
+	const size_t frameSize = static_cast<size_t>(p_Layout.strides[0]) * p_Layout.height;
+
+	if (!m_InputPlanes.Reserve(0, p_Layout.cropWidth * pixelBytes, p_Layout.cropHeight) ||
+		!m_InputPlanes.Reserve(1, chromaWidth * pixelBytes, chromaHeight) || !m_InputPlanes.Reserve(2, chromaWidth * pixelBytes, chromaHeight)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: Failed to allocate input planes");
+		return errAlloc;
+	}
+
+	if (p_SrcSize < frameSize) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: RGB buffer too small, %zu < %zu", p_SrcSize, frameSize);
+		return errFail;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	const uint64_t startCycles = g_ReadCycleCounter();
+
+	const size_t cropOffset = static_cast<size_t>(p_Layout.cropX) * m_RGBConversion.numChannels * pixelBytes;
+
+	// one job row is a chroma row, it covers vSub luma rows
+	struct RowJob
+	{
+		const RGBConversion* pConv;
+		const uint8_t* pSrc;
+		uint8_t* pDst[3];
+		uint32_t srcStride;
+		uint32_t dstStride[3];
+		uint32_t width;
+		uint32_t hSub;
+		uint32_t vSub;
+		bool isInterlaced;
+	} job = { &m_RGBConversion,
+			  p_pSrc + static_cast<size_t>(p_Layout.cropY) * p_Layout.strides[0] + cropOffset,
+			  { m_InputPlanes.GetPlane(0), m_InputPlanes.GetPlane(1), m_InputPlanes.GetPlane(2) },
+			  p_Layout.strides[0],
+			  { m_InputPlanes.GetStride(0), m_InputPlanes.GetStride(1), m_InputPlanes.GetStride(2) },
+			  p_Layout.cropWidth, hSub, vSub, IsInterlaced() };
+
+	RunRowBands(chromaHeight, [&job](uint32_t p_StartRow, uint32_t p_EndRow) {
+		for (uint32_t row = p_StartRow; row < p_EndRow; ++row) {
+			// interlaced 4:2:0 chroma row r belongs to field r & 1 and averages two luma rows of that field
+			const size_t lumaRow = (job.vSub == 1) ? row : (job.isInterlaced ? (4 * static_cast<size_t>(row >> 1) + (row & 1)) : (2 * static_cast<size_t>(row)));
+			const size_t lumaStep = job.isInterlaced ? 2 : 1;
+
+			const uint8_t* pSrc0 = job.pSrc + lumaRow * job.srcStride;
+			const uint8_t* pSrc1 = (job.vSub == 2) ? (pSrc0 + lumaStep * job.srcStride) : NULL;
+			uint8_t* pY0 = job.pDst[0] + lumaRow * job.dstStride[0];
+			uint8_t* pY1 = (job.vSub == 2) ? (pY0 + lumaStep * job.dstStride[0]) : NULL;
+			uint8_t* pU = job.pDst[1] + static_cast<size_t>(row) * job.dstStride[1];
+			uint8_t* pV = job.pDst[2] + static_cast<size_t>(row) * job.dstStride[2];
+
+			g_ConvertRGB(*job.pConv, pSrc0, pSrc1, pY0, pY1, pU, pV, job.width, job.hSub);
+		}
+	});
+
+	const uint64_t convertNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+	m_ConvertNanos += convertNanos;
+	m_ConvertMaxNanos = std::max(m_ConvertMaxNanos, convertNanos);
+	m_ConvertCycles += g_ReadCycleCounter() - startCycles;
+	m_ConvertBytes += static_cast<uint64_t>(p_Layout.cropWidth) * pixelBytes * p_Layout.cropHeight + static_cast<uint64_t>(chromaWidth) * 2 * pixelBytes * chromaHeight;
+
+	for (int i = 0; i < 3; ++i) {
+		p_pPic->planes[i] = m_InputPlanes.GetPlane(i);
+		p_pPic->stride[i] = m_InputPlanes.GetStride(i);
+	}
+
+	return errNone;
+}
+
+void X265Encoder::EncodeProxy(const uint8_t* p_pSrc, const InputFrameLayout& p_Layout, const x265_picture& p_Pic, int64_t p_PTS)
+{
+	// the proxy is downscaled from the frame x265 gets, interlaced frames are taken whole and the fields blend.
+	// NV12 chroma is read straight from the host buffer, the split and the downscale are one pass.
+	const auto startTime = std::chrono::steady_clock::now();
+
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t vSub = m_pCodec->vSubsampling;
+	const uint32_t width = m_pProxy->GetWidth();
+	const uint32_t height = m_pProxy->GetHeight();
+	const bool isNV12 = (p_Layout.colorModel == clrNV12);
+
+	struct ProxyJob
+	{
+		const uint8_t* pSrc[3];
+		uint32_t srcStride[3];
+		uint8_t* pDst[3];
+		uint32_t dstStride[3];
+		uint32_t width[2]; // luma, chroma
+		uint32_t pixelBytes;
+		bool isNV12;
+	} job;
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		job.pSrc[i] = static_cast<const uint8_t*>(p_Pic.planes[i]);
+		job.srcStride[i] = p_Pic.stride[i];
+		job.pDst[i] = m_pProxy->GetPlane(i);
+		job.dstStride[i] = m_pProxy->GetStride(i);
+	}
+	job.width[0] = width;
+	job.width[1] = width / m_pCodec->hSubsampling;
+	job.pixelBytes = pixelBytes;
+	job.isNV12 = isNV12;
+
+	if (isNV12) {
+		const size_t uvOffset = static_cast<size_t>(p_Layout.strides[0]) * p_Layout.height;
+		job.pSrc[1] = p_pSrc + uvOffset + static_cast<size_t>(p_Layout.cropY / 2) * p_Layout.strides[1] + static_cast<size_t>(p_Layout.cropX) * pixelBytes;
+		job.srcStride[1] = p_Layout.strides[1];
+	}
+
+	RunRowBands(height, [&job](uint32_t p_StartRow, uint32_t p_EndRow) {
+		for (uint32_t row = p_StartRow; row < p_EndRow; ++row) {
+			const uint8_t* pSrc0 = job.pSrc[0] + 2 * static_cast<size_t>(row) * job.srcStride[0];
+			uint8_t* pDst = job.pDst[0] + static_cast<size_t>(row) * job.dstStride[0];
+			if (job.pixelBytes == 1) {
+				g_Downscale2x2_8(pSrc0, pSrc0 + job.srcStride[0], pDst, job.width[0]);
+			} else {
+				g_Downscale2x2_16(reinterpret_cast<const uint16_t*>(pSrc0), reinterpret_cast<const uint16_t*>(pSrc0 + job.srcStride[0]), reinterpret_cast<uint16_t*>(pDst), job.width[0]);
+			}
+		}
+	});
+
+	RunRowBands(height / vSub, [&job](uint32_t p_StartRow, uint32_t p_EndRow) {
+		for (uint32_t row = p_StartRow; row < p_EndRow; ++row) {
+			uint8_t* pDstU = job.pDst[1] + static_cast<size_t>(row) * job.dstStride[1];
+			uint8_t* pDstV = job.pDst[2] + static_cast<size_t>(row) * job.dstStride[2];
+
+			if (job.isNV12) {
+				const uint8_t* pSrc0 = job.pSrc[1] + 2 * static_cast<size_t>(row) * job.srcStride[1];
+				if (job.pixelBytes == 1) {
+					g_DownscaleUV8_2x2(pSrc0, pSrc0 + job.srcStride[1], pDstU, pDstV, job.width[1]);
+				} else {
+					g_DownscaleUV16_2x2(reinterpret_cast<const uint16_t*>(pSrc0), reinterpret_cast<const uint16_t*>(pSrc0 + job.srcStride[1]),
+						reinterpret_cast<uint16_t*>(pDstU), reinterpret_cast<uint16_t*>(pDstV), job.width[1]);
+				}
+				continue;
+			}
+
+			for (uint32_t i = 1; i < 3; ++i) {
+				const uint8_t* pSrc0 = job.pSrc[i] + 2 * static_cast<size_t>(row) * job.srcStride[i];
+				uint8_t* pDst = (i == 1) ? pDstU : pDstV;
+				if (job.pixelBytes == 1) {
+					g_Downscale2x2_8(pSrc0, pSrc0 + job.srcStride[i], pDst, job.width[1]);
+				} else {
+					g_Downscale2x2_16(reinterpret_cast<const uint16_t*>(pSrc0), reinterpret_cast<const uint16_t*>(pSrc0 + job.srcStride[i]), reinterpret_cast<uint16_t*>(pDst), job.width[1]);
+				}
+			}
+		}
+	});
+
+	m_ProxyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+	// a failing proxy is dropped, the master export goes on
+	if (!m_pProxy->Encode(p_PTS, p_Pic.bitDepth)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: proxy encode failed, the proxy is stopped");
+		m_pProxy.reset();
+	}
+}
+
+void X265Encoder::FinishProxy()
+{
+	if (!m_pProxy) {
+		return;
+	}
+
+	const bool isOk = m_pProxy->Finish();
+	const StreamWriter& writer = m_pProxy->GetWriter();
+	const uint64_t numBytes = (writer.GetNumDestinations() > 0) ? writer.GetBytesWritten(0) : 0;
+	g_Log(isOk ? logLevelInfo : logLevelError, "X265 Plugin :: DoFlush :: proxy = %llu frames, %.1f MB, downscale %.3f ms/frame%s",
+		static_cast<unsigned long long>(m_pProxy->GetNumFrames()), numBytes / (1024.0 * 1024.0),
+		(m_ProxyNanos / 1000000.0) / std::max<uint64_t>(1, m_pProxy->GetNumFrames()), isOk ? "" : (((writer.GetNumDestinations() > 0) && writer.IsOverrun(0)) ? ", dropped behind" : ", failed"));
+	WriteDigests(writer, "proxy");
+
+	m_pProxy.reset();
+}
+
+void X265Encoder::ApplyFastFirstPass()
+{
+	x265_param* pFast = m_pAPI->param_alloc();
+	if ((pFast == NULL) || (m_pAPI->param_default_preset(pFast, m_pSettings->GetFirstPassPreset(), m_pSettings->GetTune()) != 0)) {
+		g_Log(logLevelError, "X265 Plugin :: SetupContext :: fast first pass preset failed, the first pass runs at the final preset");
+		if (pFast != NULL) {
+			m_pAPI->param_free(pFast);
+		}
+		return;
+	}
+
+	// motion search and mode decision of the faster preset, never slower than the final preset. The frame types
+	// (bframes, b-adapt, keyint, scenecut, lookahead) and the rate control stay those of the final pass, the
+	// second pass reads them back from the stats and its bit allocation relies on the same GOP structure.
+	m_pParam->maxNumReferences = std::min(m_pParam->maxNumReferences, pFast->maxNumReferences);
+	m_pParam->maxNumMergeCand = std::min(m_pParam->maxNumMergeCand, pFast->maxNumMergeCand);
+	m_pParam->searchMethod = std::min(m_pParam->searchMethod, pFast->searchMethod);
+	m_pParam->subpelRefine = std::min(m_pParam->subpelRefine, pFast->subpelRefine);
+	m_pParam->searchRange = std::min(m_pParam->searchRange, pFast->searchRange);
+	m_pParam->rdLevel = std::min(m_pParam->rdLevel, pFast->rdLevel);
+	m_pParam->rdoqLevel = std::min(m_pParam->rdoqLevel, pFast->rdoqLevel);
+	m_pParam->bEnableRectInter = std::min(m_pParam->bEnableRectInter, pFast->bEnableRectInter);
+	m_pParam->bEnableAMP = std::min(m_pParam->bEnableAMP, pFast->bEnableAMP);
+	m_pParam->bEnableEarlySkip = std::max(m_pParam->bEnableEarlySkip, pFast->bEnableEarlySkip);
+	m_pParam->bEnableFastIntra = std::max(m_pParam->bEnableFastIntra, pFast->bEnableFastIntra);
+	m_pParam->bEnableTSkipFast = std::max(m_pParam->bEnableTSkipFast, pFast->bEnableTSkipFast);
+	m_pParam->limitReferences = std::max(m_pParam->limitReferences, pFast->limitReferences);
+	m_pParam->limitModes = std::max(m_pParam->limitModes, pFast->limitModes);
+
+	// without the slow first pass x265 may trim the stat writing pass further on its own
+	m_pParam->rc.bEnableSlowFirstPass = 0;
+
+	g_Log(logLevelInfo, "X265 Plugin :: SetupContext :: fast first pass, %s analysis: ref %d, me %d, subme %d, rd %d", m_pSettings->GetFirstPassPreset(),
+		m_pParam->maxNumReferences, m_pParam->searchMethod, m_pParam->subpelRefine, m_pParam->rdLevel);
+
+	m_pAPI->param_free(pFast);
+}
+
+void X265Encoder::GetPictureGeometry(uint32_t p_RowBytes[3], uint32_t p_NumRows[3]) const
+{
+	// the pictures handed to x265, whole frames when interlaced
+	const uint32_t pixelBytes = GetPixelBytes();
+	const uint32_t width = m_CommonProps.GetWidth();
+	const uint32_t height = m_CommonProps.GetHeight();
+	p_RowBytes[0] = width * pixelBytes;
+	p_RowBytes[1] = (width / m_pCodec->hSubsampling) * pixelBytes;
+	p_RowBytes[2] = p_RowBytes[1];
+	p_NumRows[0] = height;
+	p_NumRows[1] = height / m_pCodec->vSubsampling;
+	p_NumRows[2] = p_NumRows[1];
+}
+
+void X265Encoder::CacheFrame(const x265_picture& p_Pic, int64_t p_PTS)
+{
+	if (m_IsFrameCacheFailed) {
+		return;
+	}
+
+	if (!m_pFrameCache) {
+		if (m_sFrameCachePath.empty()) {
+			m_IsFrameCacheFailed = true;
+			return;
+		}
+
+		// on disk scratch, never more than the budget or 90% of the free space
+		const std::string& cachePath = m_sFrameCachePath;
+		std::error_code err;
+		const std::filesystem::space_info space = std::filesystem::space(std::filesystem::path(cachePath).parent_path(), err);
+		const uint64_t maxBytes = err ? m_pSettings->GetFrameCacheBudget() : std::min<uint64_t>(m_pSettings->GetFrameCacheBudget(), space.available / 10 * 9);
+
+		uint32_t rowBytes[FrameCache::s_NumPlanes];
+		uint32_t numRows[FrameCache::s_NumPlanes];
+		GetPictureGeometry(rowBytes, numRows);
+
+		m_pFrameCache.reset(new FrameCache());
+		if (!m_pFrameCache->Create(cachePath, rowBytes, numRows, maxBytes)) {
+			g_Log(logLevelError, "X265 Plugin :: DoProcess :: failed to create the frame cache %s, the final pass is rendered again", cachePath.c_str());
+			m_IsFrameCacheFailed = true;
+			m_pFrameCache.reset();
+			return;
+		}
+
+		m_FrameCacheBitDepth = p_Pic.bitDepth;
+		g_Log(logLevelInfo, "X265 Plugin :: DoProcess :: frame cache %s, %.1f MB/frame, budget %.1f GB", cachePath.c_str(),
+			m_pFrameCache->GetFrameSize() / (1024.0 * 1024.0), maxBytes / (1024.0 * 1024.0 * 1024.0));
+	}
+
+	const uint8_t* const pPlanes[FrameCache::s_NumPlanes] = { static_cast<const uint8_t*>(p_Pic.planes[0]), static_cast<const uint8_t*>(p_Pic.planes[1]),
+		static_cast<const uint8_t*>(p_Pic.planes[2]) };
+	const uint32_t strides[FrameCache::s_NumPlanes] = { static_cast<uint32_t>(p_Pic.stride[0]), static_cast<uint32_t>(p_Pic.stride[1]), static_cast<uint32_t>(p_Pic.stride[2]) };
+
+	// a spool that cannot be completed is dropped, the host renders the final pass as it would without the cache
+	if (!m_pFrameCache->Add(pPlanes, strides, p_PTS)) {
+		g_Log(logLevelError, "X265 Plugin :: DoProcess :: frame cache %s after %llu frames, the final pass is rendered again",
+			m_pFrameCache->IsOverBudget() ? "over budget" : "write failed", static_cast<unsigned long long>(m_pFrameCache->GetNumFrames()));
+		m_IsFrameCacheFailed = true;
+		m_pFrameCache.reset();
+	}
+}
+
+bool X265Encoder::RunCachedPass()
+{
+	const char* pPassName = (m_PassesDone == 0) ? "first" : "final";
+	const double writeSeconds = m_pFrameCache->GetWriteSeconds();
+	const double megaBytes = m_pFrameCache->GetNumBytes() / (1024.0 * 1024.0);
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: frame cache = %llu frames, %.1f MB, spooled at %.1f MB/s",
+		static_cast<unsigned long long>(m_pFrameCache->GetNumFrames()), megaBytes, (writeSeconds > 0) ? (megaBytes / writeSeconds) : 0.0);
+
+	if (!m_pFrameCache->Finish()) {
+		g_Log(logLevelError, "X265 Plugin :: DoFlush :: failed to map the frame cache, the %s pass is rendered again", pPassName);
+		return false;
+	}
+
+	// the packets go to the host from here, once the nested flush counts the final pass the host sees no further pass.
+	// A first pass run from here is followed by the final pass from the same spool.
+	const auto startTime = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < m_pFrameCache->GetNumFrames(); ++i) {
+		x265_picture inPic;
+		m_pAPI->picture_init(m_pParam, &inPic);
+		inPic.bitDepth = m_FrameCacheBitDepth;
+		for (uint32_t j = 0; j < FrameCache::s_NumPlanes; ++j) {
+			inPic.planes[j] = const_cast<uint8_t*>(m_pFrameCache->GetPlane(i, j));
+			inPic.stride[j] = m_pFrameCache->GetStride(j);
+		}
+
+		const int64_t pts = m_pFrameCache->GetPTS(i);
+		if (m_pProxy) {
+			InputFrameLayout layout = {};
+			layout.colorModel = clrYUVp;
+			EncodeProxy(NULL, layout, inPic, pts);
+		}
+
+		const StatusCode sts = DeliverPackets(EncodePicture(inPic, pts));
+		if ((sts != errNone) && (sts != errMoreData)) {
+			g_Log(logLevelError, "X265 Plugin :: DoFlush :: %s pass from the frame cache failed at frame %llu", pPassName, static_cast<unsigned long long>(i));
+			m_Error = sts;
+			return true;
+		}
+	}
+
+	const double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: %s pass from the frame cache, %.1f MB/s read and encoded", pPassName, (readSeconds > 0) ? (megaBytes / readSeconds) : 0.0);
+
+	DoFlush();
+	return true;
+}
+
+std::vector<std::string> X265Encoder::GetStatSuffixes() const
+{
+	std::vector<std::string> suffixes(1, std::string());
+	if (m_pParam->rc.cuTree) {
+		suffixes.push_back(".cutree");
+	}
+	if (m_pSettings->GetAnalysisReuseLevel() > 0) {
+		suffixes.push_back(".analysis");
+	}
+
+	return suffixes;
+}
+
+uint64_t X265Encoder::GetStatsCacheKey(size_t p_NumFrames) const
+{
+	// everything that shapes the first pass, the bitrate is left out so a re-export at another rate still hits
+	std::stringstream params;
+	params << m_pAPI->version_str << ' ' << m_pCodec->pGroup << ' ' << m_pParam->sourceWidth << 'x' << m_pParam->sourceHeight << ' ' << m_pParam->fpsNum << '/'
+		   << m_pParam->fpsDenom << ' ' << m_pParam->internalCsp << ' ' << m_pParam->bField << ' ' << m_pParam->interlaceMode << ' ' << m_pParam->keyframeMin << ' '
+		   << m_pParam->keyframeMax << ' ' << m_pParam->bOpenGOP << ' ' << m_pParam->scenecutThreshold << ' ' << m_pParam->bframes << ' ' << m_pParam->bBPyramid << ' '
+		   << m_pParam->bFrameAdaptive << ' ' << m_pParam->lookaheadDepth << ' ' << m_pParam->maxNumReferences << ' ' << m_pParam->searchMethod << ' '
+		   << m_pParam->subpelRefine << ' ' << m_pParam->rdLevel << ' ' << m_pParam->rc.rateControlMode << ' ' << m_pParam->rc.cuTree << ' '
+		   << m_pSettings->GetAnalysisReuseLevel();
+	const std::string paramString = params.str();
+
+	// the prefix key covers the opening frames, the key of an entry the whole timeline
+	const uint64_t numFrames = p_NumFrames;
+	XXH64Hasher hasher;
+	hasher.Update(paramString.data(), paramString.size());
+	hasher.Update(&numFrames, sizeof(numFrames));
+	hasher.Update(m_FrameHashes.data(), p_NumFrames * sizeof(uint64_t));
+	return hasher.GetDigest();
+}
+
+bool X265Encoder::CheckStatsCache(const x265_picture& p_Pic)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	uint32_t rowBytes[3];
+	uint32_t numRows[3];
+	GetPictureGeometry(rowBytes, numRows);
+
+	XXH64Hasher hasher;
+	for (uint32_t i = 0; i < 3; ++i) {
+		const uint8_t* pRow = static_cast<const uint8_t*>(p_Pic.planes[i]);
+		for (uint32_t row = 0; row < numRows[i]; ++row) {
+			hasher.Update(pRow, rowBytes[i]);
+			pRow += p_Pic.stride[i];
+		}
+	}
+	const uint64_t frameHash = hasher.GetDigest();
+	const size_t frameIdx = m_FrameHashes.size();
+	m_FrameHashes.push_back(frameHash);
+
+	m_FrameHashNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+	if (m_IsStatsCacheBypassed) {
+		return false;
+	}
+
+	// the candidates are the entries that opened on the same frames, x265 has seen no more than those
+	if (!m_IsCheckingStats) {
+		if (m_FrameHashes.size() != s_StatsCachePrefixFrames) {
+			return false;
+		}
+
+		m_StatsPrefixKey = GetStatsCacheKey(s_StatsCachePrefixFrames);
+		if (!m_pStatsCache->Find(m_StatsPrefixKey, GetStatSuffixes(), &m_StatsCandidates)) {
+			return false;
+		}
+
+		g_Log(logLevelInfo, "X265 Plugin :: DoProcess :: stats cache %016llx has %zu candidates, the stat encode stops and the frames are compared",
+			static_cast<unsigned long long>(m_StatsPrefixKey), m_StatsCandidates.size());
+
+		// the stat files of the closed encode are replaced at the flush, or written again when nothing matches
+		m_pAPI->encoder_close(m_pContext);
+		m_pAPI->cleanup();
+		m_pContext = NULL;
+		m_IsCheckingStats = true;
+		return true;
+	}
+
+	const bool hadCandidates = !m_StatsCandidates.empty();
+	std::vector<StatsCache::Entry>::iterator it = m_StatsCandidates.begin();
+	while (it != m_StatsCandidates.end()) {
+		if ((frameIdx < it->frameHashes.size()) && (it->frameHashes[frameIdx] == frameHash)) {
+			++it;
+		} else {
+			it = m_StatsCandidates.erase(it);
+		}
+	}
+
+	if (hadCandidates && m_StatsCandidates.empty()) {
+		g_Log(logLevelInfo, "X265 Plugin :: DoProcess :: frame %zu differs from every cached first pass", frameIdx);
+	}
+
+	return true;
+}
+
+bool X265Encoder::LoadCachedStats()
+{
+	m_IsCheckingStats = false;
+
+	// a candidate that matched every frame and holds no frames beyond them is the same timeline
+	std::vector<StatsCache::Entry>::const_iterator it = m_StatsCandidates.begin();
+	while ((it != m_StatsCandidates.end()) && (it->frameHashes.size() != m_FrameHashes.size())) {
+		++it;
+	}
+
+	const bool isMatch = (it != m_StatsCandidates.end());
+	if (isMatch && m_pStatsCache->Load(m_StatsPrefixKey, it->key, m_sStatFileName, GetStatSuffixes())) {
+		m_IsStatsFromCache = true;
+		m_StatsCandidates.clear();
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: first pass stats taken from the stats cache %016llx, %llu frames compared at %.3f ms/frame",
+			static_cast<unsigned long long>(m_StatsPrefixKey), static_cast<unsigned long long>(m_FrameHashes.size()),
+			(m_FrameHashNanos / 1000000.0) / std::max<size_t>(1, m_FrameHashes.size()));
+		return true;
+	}
+
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: %s, the first pass is encoded again",
+		isMatch ? "failed to load the cached stats" : "the timeline differs from every cached first pass");
+	m_StatsCandidates.clear();
+	m_IsStatsCacheBypassed = true;
+	return false;
+}
+
+void X265Encoder::RedoFirstPass()
+{
+	SetupContext(false);
+	if (m_Error != errNone) {
+		return;
+	}
+
+	// the spool holds every frame the host rendered, the stat encode and then the final pass run from it
+	if (m_pFrameCache && RunCachedPass()) {
+		return;
+	}
+
+	// without a spool the host renders the first pass once more, IsNeedNextPass still asks for it
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: no frame cache, the host renders the first pass again");
+	m_pFrameCache.reset();
+	m_FrameHashes.clear();
+	m_FrameHashNanos = 0;
+}
+
+void X265Encoder::StoreStats()
+{
+	const std::vector<std::string> suffixes = GetStatSuffixes();
+	const uint64_t prefixKey = GetStatsCacheKey(std::min(m_FrameHashes.size(), s_StatsCachePrefixFrames));
+	const uint64_t key = GetStatsCacheKey(m_FrameHashes.size());
+
+	// x265 renames its stat files into place when the stat pass context closes
+	m_pAPI->encoder_close(m_pContext);
+	m_pAPI->cleanup();
+	m_pContext = NULL;
+
+	if (!m_pStatsCache->Store(prefixKey, key, m_FrameHashes, m_sStatFileName, suffixes)) {
+		g_Log(logLevelError, "X265 Plugin :: DoFlush :: failed to store the first pass in the stats cache");
+		return;
+	}
+
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: first pass stored in the stats cache as %016llx-%016llx, %.3f ms/frame to hash, %llu entries evicted",
+		static_cast<unsigned long long>(prefixKey), static_cast<unsigned long long>(key), (m_FrameHashNanos / 1000000.0) / std::max<size_t>(1, m_FrameHashes.size()),
+		static_cast<unsigned long long>(m_pStatsCache->GetNumEvicted()));
 }
 
 void X265Encoder::DoFlush()
@@ -787,13 +2794,70 @@ void X265Encoder::DoFlush()
 		sts = DoProcess(NULL);
 	}
 
+	CloseStream();
+	CloseIndex();
+	FinishProxy();
+
+	if (m_ConvertNanos > 0) {
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: %s conversion (%u-bit, %u threads) = %.1f MB/s, %.3f ms/frame avg, %.3f ms/frame max",
+			s_GetColorModelName(m_InputColorModel), m_pCodec->bitsPerSample, m_pConvertPool ? (m_pConvertPool->GetNumThreads() + 1) : 1, (m_ConvertBytes * 1000.0) / m_ConvertNanos,
+			(m_ConvertNanos / 1000000.0) / std::max<uint64_t>(1, m_FramesSubmitted), m_ConvertMaxNanos / 1000000.0);
+
+		// wall clock TSC cycles, compare against an NV12 / planar export of the same timeline for the host path
+		if (m_ConvertCycles > 0) {
+			g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: %s conversion = %.2f bytes/cycle", s_GetColorModelName(m_InputColorModel),
+				static_cast<double>(m_ConvertBytes) / m_ConvertCycles);
+		}
+	}
+
+	if (m_OutputPackets > 0) {
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: output = %llu packets, %.1f bytes/packet, %.2f copies/packet, %.3f bytes copied/byte sent",
+			static_cast<unsigned long long>(m_OutputPackets), static_cast<double>(m_OutputBytes) / m_OutputPackets,
+			static_cast<double>(m_OutputCopies) / m_OutputPackets, static_cast<double>(m_OutputCopyBytes) / std::max<uint64_t>(1, m_OutputBytes));
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: output delivery = %.2f host calls/packet, %.2f packets/batch",
+			static_cast<double>(m_OutputHostCalls) / m_OutputPackets, static_cast<double>(m_OutputPackets) / std::max<uint64_t>(1, m_OutputBatches));
+	}
+
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: output buffer allocations = %llu, reuses = %llu, past the pool cap = %llu",
+		static_cast<unsigned long long>(m_OutputPool.GetNumAllocs()), static_cast<unsigned long long>(m_OutputPool.GetNumReuses()),
+		static_cast<unsigned long long>(m_OutputPool.GetNumUnpooled()));
+
+	g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: input plane allocations = %llu, after open = %llu",
+		static_cast<unsigned long long>(m_InputPlanes.GetNumAllocs()),
+		static_cast<unsigned long long>(m_InputPlanes.GetNumAllocs() - m_PlaneAllocsAtOpen));
+
+	// the stat encode stopped at a cache hit, the pass only counts once the whole timeline matched an entry
+	if (m_IsCheckingStats && !LoadCachedStats()) {
+		RedoFirstPass();
+		return;
+	}
+
 	++m_PassesDone;
 
+	const double passSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_PassStartTime).count();
+	if (!m_IsMultiPass) {
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: encode = %.1f s", passSeconds);
+	} else if (m_PassesDone == 1) {
+		m_FirstPassSeconds = passSeconds;
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: first pass = %.1f s%s", passSeconds, m_pSettings->IsFastFirstPass() ? ", fast" : "");
+	} else {
+		g_Log(logLevelInfo, "X265 Plugin :: DoFlush :: first pass = %.1f s, final pass = %.1f s, first pass share = %.0f%%", m_FirstPassSeconds, passSeconds,
+			(100.0 * m_FirstPassSeconds) / std::max(1e-9, m_FirstPassSeconds + passSeconds));
+	}
+
 	if (!m_IsMultiPass || (m_PassesDone > 1)) {
 		return;
 	}
 
 	if (m_PassesDone == 1) {
+		if (m_pStatsCache && !m_IsStatsFromCache && !m_FrameHashes.empty() && (m_Error == errNone)) {
+			StoreStats();
+		}
 		SetupContext(true /* isFinalPass */);
 	}
+
+	if (m_pFrameCache && (m_Error == errNone)) {
+		RunCachedPass();
+	}
+	m_pFrameCache.reset();
 }
\ No newline at end of file
@@ -1,28 +1,77 @@
 #pragma once
 #pragma once
 
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "wrapper/plugin_api.h"
 
+#include "frame_cache.h"
+#include "gop_index.h"
+#include "output_pool.h"
+#include "pixel_convert.h"
+#include "plane_pool.h"
+#include "proxy_encoder.h"
+#include "stats_cache.h"
+#include "stream_writer.h"
+#include "worker_pool.h"
+
 using namespace IOPlugin;
 
+struct x265_api;
 struct x265_encoder;
+struct x265_nal;
 struct x265_param;
+struct x265_picture;
 
 class UISettingsController;
 
+// a registered codec entry, all entries share the X265Encoder implementation
+struct X265CodecDesc
+{
+	const uint8_t* pUUID;
+	const char* pGroup;
+	const char* pProfile;
+	uint32_t bitDepth; // encoded bit depth, selects the x265 api
+	uint32_t bitsPerSample; // sample container delivered by the host
+	uint8_t hSubsampling;
+	uint8_t vSubsampling;
+	uint32_t packedColorModel; // interleaved 4:2:2 format unpacked by the plugin, clrUnknown if none
+};
+
+// geometry of a locked host frame, strides are in bytes and may include padding
+struct InputFrameLayout
+{
+	uint32_t colorModel;
+	uint32_t width;
+	uint32_t height;
+	uint32_t strides[3];
+	uint32_t cropX;
+	uint32_t cropY;
+	uint32_t cropWidth;
+	uint32_t cropHeight;
+};
+
 class X265Encoder : public IPluginCodecRef
 {
 public:
 	static const uint8_t s_UUID[];
+	static const uint8_t s_UUIDMain10[];
+	static const uint8_t s_UUIDMain422_10[];
+	static const uint8_t s_UUIDMain444[];
 
 public:
-	X265Encoder();
+	explicit X265Encoder(const X265CodecDesc* p_pCodec);
 	~X265Encoder();
 
+	static const X265CodecDesc* s_FindCodec(const uint8_t* p_pUUID);
 	static StatusCode s_RegisterCodecs(HostListRef* p_pList);
-	static StatusCode s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList);
+	static StatusCode s_GetEncoderSettings(const X265CodecDesc* p_pCodec, HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList);
 
 	virtual bool IsNeedNextPass() override
 	{
@@ -43,15 +92,134 @@ protected:
 	virtual StatusCode DoProcess(HostBufferRef* p_pBuff) override;
 
 private:
+	static StatusCode s_RegisterCodec(const X265CodecDesc& p_Codec, HostListRef* p_pList);
+
+	uint32_t GetPixelBytes() const
+	{
+		return (m_pCodec->bitsPerSample > 8) ? 2 : 1;
+	}
+
+	bool IsInterlaced() const
+	{
+		return (m_FieldOrder != 0);
+	}
+
+	void SetupStatFiles(const std::string& p_OutputPath);
+	void RemoveStatFiles();
 	void SetupContext(bool p_IsFinalPass);
+	void ApplyFastFirstPass();
+	bool SetupInputPlanes();
+	void RunRowBands(uint32_t p_NumRows, const std::function<void(uint32_t p_StartRow, uint32_t p_EndRow)>& p_ConvertRows);
+	StatusCode LoadFrameLayout(HostBufferRef* p_pBuff, uint32_t p_ColorModel, InputFrameLayout* p_pLayout);
+	StatusCode SetupNV12Picture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic);
+	StatusCode SetupPlanarPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic);
+	StatusCode SetupPackedPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic);
+	StatusCode SetupRGBPicture(uint8_t* p_pSrc, size_t p_SrcSize, const InputFrameLayout& p_Layout, x265_picture* p_pPic);
+	StatusCode EncodePicture(const x265_picture& p_Pic, int64_t p_PTS);
+	StatusCode ProcessEncoded(int p_EncoderRet, x265_nal* p_pNals, uint32_t p_NumNals, const x265_picture& p_OutPic);
+	StatusCode QueuePendingFrames(bool p_IsDraining);
+	int64_t GetFrameDTS(int64_t p_FirstFieldDTS) const;
+	StatusCode QueuePacket(const std::vector<uint8_t>* p_pPrefix, const x265_nal* p_pNals, uint32_t p_NumNals, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsKeyFrame);
+	StatusCode DeliverPackets(StatusCode p_Sts);
+	std::vector<std::string> GetStreamPaths(const std::filesystem::path& p_Path) const;
+	std::filesystem::path GetStreamPath() const;
+	void WriteStream(const uint8_t* p_pData, size_t p_Size);
+	void CloseStream();
+	void WriteDigests(const StreamWriter& p_Writer, const char* p_pName);
+	void WriteIndex(const uint8_t* p_pData, size_t p_Size, int64_t p_PTS, int64_t p_DTS, int p_SliceType, bool p_IsKeyFrame);
+	void CloseIndex();
+	void EncodeProxy(const uint8_t* p_pSrc, const InputFrameLayout& p_Layout, const x265_picture& p_Pic, int64_t p_PTS);
+	void FinishProxy();
+	void GetPictureGeometry(uint32_t p_RowBytes[3], uint32_t p_NumRows[3]) const;
+	void CacheFrame(const x265_picture& p_Pic, int64_t p_PTS);
+	bool RunCachedPass();
+	std::vector<std::string> GetStatSuffixes() const;
+	uint64_t GetStatsCacheKey(size_t p_NumFrames) const;
+	bool CheckStatsCache(const x265_picture& p_Pic);
+	bool LoadCachedStats();
+	void RedoFirstPass();
+	void StoreStats();
 
 private:
+	const X265CodecDesc* m_pCodec;
+	const x265_api* m_pAPI;
 	x265_encoder* m_pContext;
 	x265_param* m_pParam;
 	int m_ColorModel;
+	uint32_t m_InputColorModel;
+	uint8_t m_FieldOrder; // 0 - progressive, 1 - top field first, 2 - bottom field first
+	int16_t m_ColorPrimaries;
+	int16_t m_TransferCharacteristics;
+	RGBConversion m_RGBConversion;
 	std::string m_sStatFileName;
+	std::string m_sAnalysisFileName; // x265 analysis of the stat pass, loaded by the final pass
+	std::string m_sFrameCachePath; // first pass frame spool, on disk scratch and never on tmpfs
 	std::unique_ptr<UISettingsController> m_pSettings;
 	HostCodecConfigCommon m_CommonProps;
+	PlanePool m_InputPlanes;
+	uint64_t m_PlaneAllocsAtOpen;
+	std::unique_ptr<WorkerPool> m_pConvertPool;
+	uint64_t m_ConvertNanos;
+	uint64_t m_ConvertMaxNanos;
+	uint64_t m_ConvertBytes;
+	uint64_t m_ConvertCycles;
+
+	// fields of an interlaced frame wait here until the frame can go out as one packet
+	struct PendingFrame
+	{
+		int64_t frameNum;
+		int64_t firstFieldDTS;
+		int sliceType;
+		bool isKeyFrame;
+		uint32_t numFields;
+		std::vector<uint8_t> data;
+	};
+	std::deque<PendingFrame> m_PendingFrames;
+	int64_t m_LastDTS;
+	bool m_HasLastDTS;
+
+	HostBufferPool m_OutputPool;
+	std::vector<HostBufferPool::Buffer*> m_OutputQueue;
+	uint64_t m_OutputHostCalls;
+	uint64_t m_OutputBatches;
+	uint64_t m_OutputPackets;
+	uint64_t m_OutputBytes;
+	uint64_t m_OutputCopyBytes;
+	uint64_t m_OutputCopies;
+
+	// optional Annex-B copy of the final pass, x265 headers are only emitted once at open
+	std::unique_ptr<StreamWriter> m_pStreamWriter;
+	std::vector<uint8_t> m_StreamHeaders;
+	bool m_IsStreamFailed;
+	uint32_t m_NumStreamOverruns; // destinations dropped for falling behind, already logged
+
+	// access unit index of the final pass, offsets follow the elementary stream layout
+	std::unique_ptr<GOPIndexWriter> m_pIndexWriter;
+	bool m_IsIndexFailed;
+
+	// half resolution proxy of the final pass, encoded from the same locked frame
+	std::unique_ptr<ProxyEncoder> m_pProxy;
+	std::string m_NumaPools; // master x265 pool size while the proxy runs
+	uint64_t m_ProxyNanos;
+
+	// first pass pictures as x265 got them, the final pass is encoded from the spool inside DoFlush
+	std::unique_ptr<FrameCache> m_pFrameCache;
+	bool m_IsFrameCacheFailed;
+	int m_FrameCacheBitDepth; // x265_picture bitDepth of the spooled frames
+
+	// first pass stats kept across exports, an entry is keyed by the stat pass parameters and the frame hashes
+	std::unique_ptr<StatsCache> m_pStatsCache;
+	std::vector<uint64_t> m_FrameHashes; // frames of this first pass
+	std::vector<StatsCache::Entry> m_StatsCandidates; // entries still matching every frame so far
+	uint64_t m_StatsPrefixKey;
+	bool m_IsCheckingStats; // the opening frames matched, x265 sees no further frame of the first pass
+	bool m_IsStatsFromCache;
+	bool m_IsStatsCacheBypassed; // nothing matched, the repeated first pass is encoded for real
+	uint64_t m_FrameHashNanos;
+
+	// wall clock of each pass, from its context setup to its flush
+	std::chrono::steady_clock::time_point m_PassStartTime;
+	double m_FirstPassSeconds;
 
 	bool m_IsMultiPass;
 	uint64_t m_FramesSubmitted;
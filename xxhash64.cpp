@@ -0,0 +1,133 @@
+#include "xxhash64.h"
+
+#include <string.h>
+
+static const uint64_t s_Prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t s_Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t s_Prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t s_Prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t s_Prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t s_RotateLeft(uint64_t p_Value, int p_Bits)
+{
+	return (p_Value << p_Bits) | (p_Value >> (64 - p_Bits));
+}
+
+// the specification reads little-endian lanes, every platform the plugin is built for is little-endian
+static inline uint64_t s_Read64(const uint8_t* p_pData)
+{
+	uint64_t value;
+	memcpy(&value, p_pData, sizeof(value));
+	return value;
+}
+
+static inline uint32_t s_Read32(const uint8_t* p_pData)
+{
+	uint32_t value;
+	memcpy(&value, p_pData, sizeof(value));
+	return value;
+}
+
+static inline uint64_t s_Round(uint64_t p_Acc, uint64_t p_Lane)
+{
+	return s_RotateLeft(p_Acc + p_Lane * s_Prime2, 31) * s_Prime1;
+}
+
+static inline uint64_t s_MergeRound(uint64_t p_Acc, uint64_t p_Value)
+{
+	return (p_Acc ^ s_Round(0, p_Value)) * s_Prime1 + s_Prime4;
+}
+
+XXH64Hasher::XXH64Hasher(uint64_t p_Seed)
+{
+	Reset(p_Seed);
+}
+
+void XXH64Hasher::Reset(uint64_t p_Seed)
+{
+	m_Seed = p_Seed;
+	m_Acc[0] = p_Seed + s_Prime1 + s_Prime2;
+	m_Acc[1] = p_Seed + s_Prime2;
+	m_Acc[2] = p_Seed;
+	m_Acc[3] = p_Seed - s_Prime1;
+	m_StripeSize = 0;
+	m_NumBytes = 0;
+}
+
+void XXH64Hasher::Update(const void* p_pData, size_t p_Size)
+{
+	const uint8_t* pData = static_cast<const uint8_t*>(p_pData);
+	m_NumBytes += p_Size;
+
+	if (m_StripeSize > 0) {
+		const size_t numFill = (p_Size < 32 - m_StripeSize) ? p_Size : (32 - m_StripeSize);
+		memcpy(m_Stripe + m_StripeSize, pData, numFill);
+		m_StripeSize += numFill;
+		pData += numFill;
+		p_Size -= numFill;
+
+		if (m_StripeSize < 32) {
+			return;
+		}
+
+		for (int i = 0; i < 4; ++i) {
+			m_Acc[i] = s_Round(m_Acc[i], s_Read64(m_Stripe + 8 * i));
+		}
+		m_StripeSize = 0;
+	}
+
+	// the four lanes are independent, the compiler keeps them in registers
+	uint64_t acc0 = m_Acc[0];
+	uint64_t acc1 = m_Acc[1];
+	uint64_t acc2 = m_Acc[2];
+	uint64_t acc3 = m_Acc[3];
+	for (; p_Size >= 32; pData += 32, p_Size -= 32) {
+		acc0 = s_Round(acc0, s_Read64(pData));
+		acc1 = s_Round(acc1, s_Read64(pData + 8));
+		acc2 = s_Round(acc2, s_Read64(pData + 16));
+		acc3 = s_Round(acc3, s_Read64(pData + 24));
+	}
+	m_Acc[0] = acc0;
+	m_Acc[1] = acc1;
+	m_Acc[2] = acc2;
+	m_Acc[3] = acc3;
+
+	memcpy(m_Stripe, pData, p_Size);
+	m_StripeSize = p_Size;
+}
+
+uint64_t XXH64Hasher::GetDigest() const
+{
+	uint64_t hash = 0;
+	if (m_NumBytes >= 32) {
+		hash = s_RotateLeft(m_Acc[0], 1) + s_RotateLeft(m_Acc[1], 7) + s_RotateLeft(m_Acc[2], 12) + s_RotateLeft(m_Acc[3], 18);
+		for (int i = 0; i < 4; ++i) {
+			hash = s_MergeRound(hash, m_Acc[i]);
+		}
+	} else {
+		hash = m_Seed + s_Prime5;
+	}
+
+	hash += m_NumBytes;
+
+	const uint8_t* pData = m_Stripe;
+	size_t size = m_StripeSize;
+	for (; size >= 8; pData += 8, size -= 8) {
+		hash = s_RotateLeft(hash ^ s_Round(0, s_Read64(pData)), 27) * s_Prime1 + s_Prime4;
+	}
+	if (size >= 4) {
+		hash = s_RotateLeft(hash ^ (s_Read32(pData) * s_Prime1), 23) * s_Prime2 + s_Prime3;
+		pData += 4;
+		size -= 4;
+	}
+	for (; size > 0; ++pData, --size) {
+		hash = s_RotateLeft(hash ^ (*pData * s_Prime5), 11) * s_Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= s_Prime2;
+	hash ^= hash >> 29;
+	hash *= s_Prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
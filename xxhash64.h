@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming XXH64 (xxHash specification 0.1.1), fed in pieces of any size. The digest matches
+// xxhsum -H1 over the same bytes.
+class XXH64Hasher
+{
+public:
+	explicit XXH64Hasher(uint64_t p_Seed = 0);
+
+	void Reset(uint64_t p_Seed = 0);
+	void Update(const void* p_pData, size_t p_Size);
+	// the state stays valid, more data can follow
+	uint64_t GetDigest() const;
+
+	uint64_t GetNumBytes() const
+	{
+		return m_NumBytes;
+	}
+
+private:
+	uint64_t m_Acc[4];
+	uint8_t m_Stripe[32]; // bytes that do not fill a stripe yet
+	size_t m_StripeSize;
+	uint64_t m_NumBytes;
+	uint64_t m_Seed;
+};